@@ -1,525 +1,7080 @@
 /**
  * @file arvore_bplus.cpp
- * @brief Implementação de uma folha de Árvore B+ em arquivo binário
+ * @brief Implementação de uma Árvore B+ em arquivo binário paginado
  * @author Luiz Otávio de Queiroz Lage Silva
  * @author Bernardo Carvalho Guerra Martins da Costa
  * @date 2025-06-29
- * 
+ *
  * Trabalho de AEDS 2 - UNIFEI Campus Itabira
  * Professor: Rafael Francisco dos Santos
- * 
- * Este código implementa as operações básicas de uma folha de Árvore B+ usando
+ *
+ * Este código implementa as operações básicas de uma Árvore B+ usando
  * arquivos binários, com inserção, remoção, pesquisa e impressão de registros.
  * Todas as operações são feitas diretamente no arquivo sem carregar todos os
  * dados para memória principal.
+ *
+ * O arquivo pagina.dat é dividido em páginas de tamanho fixo (4 KiB ou 8 KiB,
+ * escolhido na criação). Cada página folha guarda um vetor ordenado de
+ * registros e as folhas formam uma lista duplamente encadeada; as páginas
+ * internas guardam chaves separadoras e os filhos. Uma pesquisa lê O(log_B n)
+ * páginas e faz busca binária dentro de cada uma.
  */
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <unordered_map>
+#include <set>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <thread>
+#include <cerrno>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 using namespace std;
 
+/**
+ * @struct chaveInteira
+ * @brief Operações de uma chave inteira usadas pela árvore
+ * @tparam T Tipo da chave
+ * @tparam D Tipo dos separadores das páginas internas compactas (metade de T)
+ * @tparam A Assinatura do formato paginado com esta chave
+ *
+ * Tudo o que depende da chave passa por aqui: a ordem (menor), os limites
+ * do intervalo, a distância até a base que as páginas compactas guardam
+ * em D e a leitura da chave em texto. As funções são constexpr ou
+ * embutidas, então as comparações não custam uma chamada, e as
+ * capacidades das páginas saem de sizeof(T). As buscas vetoriais da
+ * página (procurarAvx2, procurarSse2, procurarNeon) são versões
+ * específicas de cada tipo inteiro, escolhidas por escolherBusca.
+ */
+template <class T, class D, unsigned A>
+struct chaveInteira {
+    typedef T tipo;                         ///< Chave
+    typedef D delta;                        ///< Distância até a base, nas páginas compactas
+    static constexpr unsigned assinatura = A; ///< Identifica o formato paginado
+    static_assert(2*sizeof(D) == sizeof(T), "a distancia ocupa metade da chave");
+
+    /// Ordem das chaves, a mesma das colunas comparadas pelas buscas
+    static constexpr bool menor(T a, T b) { return a < b; }
+    /// Menor chave possível (limite inferior da raiz)
+    static constexpr T minimo() { return numeric_limits<T>::min(); }
+    /// Maior chave possível (limite superior da raiz)
+    static constexpr T maximo() { return numeric_limits<T>::max(); }
+    /// Quanto alto está acima de baixo (alto >= baixo), sem estouro
+    static constexpr unsigned long long distancia(T baixo, T alto) {
+        return (unsigned long long)alto - (unsigned long long)baixo;
+    }
+    /// Chave que está d acima de base
+    static constexpr T deslocar(T base, unsigned long long d) { return (T)((unsigned long long)base + d); }
+    /// Bits da chave, para o hash do filtro de Bloom
+    static constexpr unsigned long long bits(T chave) { return (unsigned long long)chave; }
+
+    /**
+     * @brief Lê uma chave em decimal
+     * @param texto Início do número
+     * @param fim Recebe o primeiro caractere depois do número (texto se não há número)
+     * @param chave Recebe a chave
+     * @return false se não há número ou ele não cabe em T
+     */
+    static bool ler(const char *texto, char *&fim, T &chave) {
+        errno = 0;
+        long long valor = strtoll(texto, &fim, 10);
+        if (fim == texto || errno == ERANGE || valor < minimo() || valor > maximo()) return false;
+        chave = (T)valor;
+        return true;
+    }
+};
+
+template <class T> struct tracosChave;  ///< Chaves aceitas pela árvore (só as especializações abaixo)
+template <> struct tracosChave<int> : chaveInteira<int, short, 0x36545042> {};             ///< "BPT6"
+template <> struct tracosChave<long long> : chaveInteira<long long, int, 0x364c5042> {};   ///< "BPL6"
+
+// Chave escolhida na compilação: -DCHAVE_64 troca a chave para 64 bits. O
+// arquivo ganha outra assinatura, e um arquivo de um tipo não abre com o
+// programa do outro.
+#ifdef CHAVE_64
+typedef tracosChave<long long> tracos;  ///< Chave de 64 bits
+#else
+typedef tracosChave<int> tracos;        ///< Chave de 32 bits
+#endif
+typedef tracos::tipo tipoChave;         ///< Chave dos registros
+typedef tracos::delta tipoDelta;        ///< Separador de página interna compacta (distância até a base)
+
 /**
  * @struct dados
  * @brief Armazena os dados de um registro
  * @var chave Identificador único do registro (valor inteiro)
- * @var nome Campo de dados associado à chave (30 caracteres fixos)
+ * @var nome Valor associado à chave, de tamanho variável (até VALOR_MAX bytes)
  */
 struct dados {
-    int chave;      ///< Chave única para identificação do registro
-    char nome[30];  ///< Nome ou valor associado à chave
+    tipoChave chave;  ///< Chave única para identificação do registro
+    string nome;      ///< Nome ou valor associado à chave
+};
+
+/**
+ * @struct registroBinario
+ * @brief Registro de tamanho fixo da entrada binária da carga em massa
+ */
+struct registroBinario {
+    tipoChave chave;  ///< Chave do registro
+    char nome[30];    ///< Nome, completado com zeros
+};
+
+#define TAM_PAGINA_MAX 8192      ///< Maior tamanho de página suportado (bytes)
+#define MAX_ALTURA 16            ///< Número máximo de níveis internos suportados
+
+#define PAGINA_LIVRE 0           ///< Página na lista de páginas livres
+#define PAGINA_FOLHA 1           ///< Página folha (registros)
+#define PAGINA_INTERNA 2         ///< Página interna (separadores e filhos)
+#define PAGINA_EXCEDENTE 3       ///< Continuação de um valor grande demais para a folha
+#define PAGINA_COMPRIMIDA 4      ///< Folha fria como fica no arquivo (em memória volta a ser folha)
+
+#define LIMIAR_PADRAO 128        ///< Maior valor guardado na própria folha, por padrão (bytes)
+#define VALOR_MAX 32768          ///< Maior valor aceito (bytes)
+
+/**
+ * @struct entrada
+ * @brief Par (separador, filho) de uma página interna
+ *
+ * No item 0 só o filho é usado; no item i (i >= 1) a chave separa o
+ * filho i - 1 do filho i.
+ */
+struct entrada {
+    tipoChave chave;  ///< Menor chave que pode estar no filho
+    int filho;        ///< Número da página filha
 };
 
 /**
- * @union celula
- * @brief Union que representa tanto o cabeçalho quanto os nós da lista
- * 
+ * @union pagina
+ * @brief Union que representa o cabeçalho e os tipos de página do arquivo
+ *
  * Pode armazenar:
- * - Cabeçalho: contém metadados sobre a estrutura do arquivo
- * - Nó da lista: contém os dados e ponteiros para outros nós
+ * - Cabeçalho: contém metadados sobre a estrutura do arquivo (página 0)
+ * - Folha: chaves ordenadas, slots e valores de tamanho variável, e
+ *   ponteiros para as folhas vizinhas
+ * - Interna: separadores e números das páginas filhas
+ * - Excedente: pedaço de um valor maior que o limiar
+ * - Livre: ponteiro para a próxima página livre
+ *
+ * Em memória a union sempre ocupa TAM_PAGINA_MAX bytes; no arquivo cada
+ * página ocupa cabecalho.tamPagina bytes e a capacidade dos vetores é
+ * calculada a partir desse tamanho.
  */
-union celula {
+union pagina {
     /**
      * @struct cabecalho
      * @brief Estrutura de controle do arquivo
      */
     struct {
-        int quant;  ///< Quantidade de registros ativos no arquivo
-        int first;  ///< Índice do primeiro registro na lista
-        int last;   ///< Índice do último registro na lista
-        int free;   ///< Índice do primeiro nó na lista de espaços livres
-        int tam;    ///< Capacidade total de registros no arquivo
+        int quant;      ///< Quantidade de registros ativos no arquivo
+        int first;      ///< Página da primeira folha
+        int last;       ///< Página da última folha
+        int free;       ///< Primeira página na lista de páginas livres
+        int tam;        ///< Capacidade total de páginas (sem contar o cabeçalho)
+        int raiz;       ///< Página raiz (folha quando altura = 0)
+        int altura;     ///< Quantidade de níveis internos
+        int tamPagina;  ///< Tamanho de cada página em bytes
+        int livres;     ///< Páginas disponíveis (lista de livres e nunca usadas)
+        int assinatura; ///< Identificação do formato do arquivo
+        int alto;       ///< Maior página já usada; as seguintes até tam nunca foram usadas
+        int limiar;     ///< Maior valor guardado na própria folha; os maiores vão para o excedente
+        int frias;      ///< 1 se pode haver folhas comprimidas no arquivo (ver esfriar)
     } cabecalho;
-    
+
+    /**
+     * @struct folha
+     * @brief Página folha com registros ordenados por chave
+     *
+     * As quant chaves ficam juntas no início da página, para que a busca
+     * só percorra as linhas de cache das chaves. Logo depois vêm os quant
+     * slots (ver slotsFolha), com a posição e o tamanho do valor de cada
+     * registro. Os valores ocupam o fim da página, de topo até tamPagina,
+     * e crescem para trás; o espaço livre fica entre os slots e topo. O
+     * vetor chave vai até o fim da union apenas para fins de declaração.
+     */
+    struct {
+        int tipo;   ///< PAGINA_FOLHA
+        int quant;  ///< Quantidade de registros ocupados na página
+        int next;   ///< Página da próxima folha (-1 se última)
+        int prev;   ///< Página da folha anterior (-1 se primeira)
+        int topo;   ///< Início da área de valores
+        int lixo;   ///< Bytes da área de valores de registros já removidos
+        tipoChave chave[(TAM_PAGINA_MAX - 6*sizeof(int)) / sizeof(tipoChave)];  ///< Chaves, em ordem crescente
+    } folha;
+
+    /**
+     * @struct interna
+     * @brief Página interna do índice
+     *
+     * O filho i contém as chaves c tais que chave[i] <= c < chave[i+1]. Como
+     * na folha, os separadores ficam juntos no início da página (chave[0]
+     * não é usada) e os números dos filhos ocupam o fim da página, do
+     * último byte para trás (ver filhoInterna). Na página compacta chave[0]
+     * guarda uma base e os separadores são guardados logo depois dela como
+     * distâncias em tipoDelta, com metade do tamanho de uma chave (ver
+     * separadorInterna).
+     */
+    struct {
+        int tipo;     ///< PAGINA_INTERNA
+        int quant;    ///< Quantidade de chaves separadoras (filhos = quant + 1)
+        int compacta; ///< 1 se os separadores são distâncias até chave[0]
+        int prev;     ///< Não usado
+        tipoChave chave[(TAM_PAGINA_MAX - 4*sizeof(int)) / sizeof(tipoChave)];  ///< Separadores, em ordem crescente
+    } interna;
+
     /**
-     * @struct lista
-     * @brief Estrutura de um nó de dados
+     * @struct excedente
+     * @brief Pedaço de um valor maior que o limiar, fora da folha
+     *
+     * Os pedaços de um valor formam uma lista encadeada; a folha guarda o
+     * comprimento total e a primeira página (ver referenciaExcedente).
      */
     struct {
-        int next;   ///< Índice do próximo nó na lista (-1 se último)
-        int prev;   ///< Índice do nó anterior na lista (-1 se primeiro)
-        dados reg;  ///< Dados armazenados neste nó
-    } lista;
+        int tipo;         ///< PAGINA_EXCEDENTE
+        int quant;        ///< Bytes do valor nesta página
+        int next;         ///< Próxima página do valor (-1 se última)
+        int prev;         ///< Página anterior do valor (-1 se é a primeira, apontada pela folha)
+        tipoChave chave;  ///< Chave do registro dono do valor
+        char valor[TAM_PAGINA_MAX - 4*sizeof(int) - sizeof(tipoChave)];  ///< Bytes do valor
+    } excedente;
+
+    /**
+     * @struct livre
+     * @brief Página disponível para reutilização
+     */
+    struct {
+        int tipo;   ///< PAGINA_LIVRE
+        int quant;  ///< Não usado
+        int next;   ///< Próxima página livre (-1 se última)
+        int prev;   ///< Não usado
+    } livre;
+
+    /**
+     * @struct comprimida
+     * @brief Folha fria do jeito que está gravada no arquivo
+     *
+     * Só existe no disco: ao ser lida, a página volta a ser uma folha no
+     * buffer pool (ver expandirFolha). Os bytes depois de tam até o fim da
+     * página não são usados e ficam como um buraco no arquivo.
+     */
+    struct {
+        int tipo;      ///< PAGINA_COMPRIMIDA
+        int tam;       ///< Bytes comprimidos em dados
+        int original;  ///< Bytes da folha serializada (ver serializarFolha)
+        int prev;      ///< Não usado
+        unsigned char dados[TAM_PAGINA_MAX - 4*sizeof(int)];  ///< Folha serializada e comprimida (ver comprimirLz)
+    } comprimida;
+
+    char bytes[TAM_PAGINA_MAX];  ///< Conteúdo bruto da página
+};
+
+#define QUADROS_PADRAO 256              ///< Capacidade padrão do buffer pool (quadros)
+#define QUADROS_MIN (2*MAX_ALTURA + 8)  ///< Quadros fixados ao mesmo tempo no pior caso
+
+/**
+ * @struct quadro
+ * @brief Controle de um quadro do buffer pool
+ *
+ * Um quadro guarda uma página do arquivo em memória. Enquanto estiver
+ * fixado (pinos > 0) ele não pode ser substituído; quando sujo, a página
+ * é gravada no arquivo antes de o quadro ser reaproveitado.
+ */
+struct quadro {
+    int pos;      ///< Página carregada no quadro (-1 se vazio)
+    int pinos;    ///< Quantidade de fixações ativas
+    bool sujo;    ///< Página alterada desde a última gravação
+    bool ref;     ///< Bit de referência do algoritmo CLOCK
+    bool pendente;///< Alterada pela operação ainda não confirmada no log
+    bool fria;    ///< Folha fria: gravada comprimida (gravarQuadro)
+    long long lsn;///< Último bloco do log com a imagem da página
+    long long epoca; ///< Escrita que travou a página por último (0 se desconhecida)
+    bool carregando; ///< Reservado por reservarQuadro: a página está sendo gravada ou lida fora de mCache
+};
+
+/**
+ * @struct versaoPagina
+ * @brief Imagem anterior de uma página, guardada para os instantâneos
+ *
+ * É o conteúdo que a página tinha antes da escrita de número ate: vale
+ * para todo instantâneo aberto antes dela e depois da imagem anterior da
+ * mesma página.
+ */
+struct versaoPagina {
+    long long ate;      ///< Primeira escrita que alterou a página depois desta imagem
+    vector<char> bytes; ///< Conteúdo da página
+};
+
+/**
+ * @struct travaThread
+ * @brief Trava de quadro mantida pela thread atual
+ *
+ * Uma mesma página pode ser fixada mais de uma vez pela mesma thread (por
+ * exemplo, a folha e o vizinho que já está no caminho); a trava do quadro
+ * só é adquirida na primeira fixação e liberada na última.
+ */
+struct travaThread {
+    int quadro;      ///< Índice do quadro travado
+    int usos;        ///< Fixações da thread que dependem da trava
+    bool exclusiva;  ///< Trava de escrita (true) ou de leitura (false)
+};
+
+// Contadores de instrumentação, por tipo de operação. Só existem quando o
+// programa é compilado com -DESTATISTICAS; sem a opção, ESTATISTICA,
+// CONTAR e MEDIR_ES não geram código e as consultas devolvem zero.
+#define ESTAT_PESQUISA 0       ///< pesquisa
+#define ESTAT_INSERCAO 1       ///< inserir, inserirOrdenado, inserirOuSubstituir
+#define ESTAT_REMOCAO 2        ///< remover, removerReferencia, removerIntervalo
+#define ESTAT_INTERVALO 3      ///< posicionar, proximo e anterior do cursor
+#define ESTAT_LOTE 4           ///< inserirLote
+#define ESTAT_COMPACTACAO 5    ///< compactar
+#define ESTAT_CONFIRMACAO 6    ///< confirmar e checkpoint
+#define TIPOS_ESTAT 7          ///< Quantidade de tipos de operação
+
+#define CONT_OPERACOES 0       ///< Operações (chamadas) iniciadas
+#define CONT_NS_OPERACAO 1     ///< Tempo total dentro das operações (ns)
+#define CONT_ACERTOS 2         ///< Páginas pedidas que já estavam no cache
+#define CONT_FALTAS 3          ///< Páginas que precisaram ser lidas do disco
+#define CONT_LEITURAS 4        ///< Chamadas de leitura (pread)
+#define CONT_BYTES_LIDOS 5     ///< Bytes lidos
+#define CONT_GRAVACOES 6       ///< Chamadas de gravação (pwrite e write do log)
+#define CONT_BYTES_GRAVADOS 7  ///< Bytes gravados
+#define CONT_SINCRONIZACOES 8  ///< Chamadas de fsync, fdatasync e msync
+#define CONT_NS_ES 9           ///< Tempo nas chamadas de leitura, gravação e sincronização (ns)
+#define CONT_DESCIDAS 10       ///< Descidas da raiz até uma folha
+#define CONT_NIVEIS 11         ///< Páginas visitadas nas descidas
+#define CONT_OTIMISTAS 12      ///< Tentativas de leitura otimista
+#define CONT_CELULAS_LIDAS 13  ///< Registros lidos de folhas
+#define CONT_CELULAS_GRAVADAS 14 ///< Registros gravados ou removidos em folhas
+#define CONT_FILTRADAS 15      ///< Chaves descartadas pelo filtro de Bloom, sem descer na árvore
+#define CONT_VERSOES 16        ///< Imagens de páginas guardadas para instantâneos abertos
+#define QUANT_CONT 17          ///< Quantidade de contadores
+
+const char *const nomesEstat[TIPOS_ESTAT] = {
+    "pesquisa", "insercao", "remocao", "intervalo", "lote", "compactacao", "confirmacao"
+};
+const char *const nomesCont[QUANT_CONT] = {
+    "operacoes", "ns_operacao", "acertos", "faltas", "leituras", "bytes_lidos", "gravacoes",
+    "bytes_gravados", "sincronizacoes", "ns_es", "descidas", "niveis", "otimistas",
+    "celulas_lidas", "celulas_gravadas", "filtradas", "versoes"
+};
+
+/**
+ * @struct contadoresOperacao
+ * @brief Contadores de um tipo de operação
+ *
+ * Somados com memory_order_relaxed: leitores de várias threads contam ao
+ * mesmo tempo e ninguém depende da ordem entre os contadores.
+ */
+struct contadoresOperacao {
+    atomic<long long> valor[QUANT_CONT];  ///< Indexado por CONT_*
+};
+
+/**
+ * @struct estadoThread
+ * @brief Estado de concorrência de cada thread que usa o arquivo
+ */
+struct estadoThread {
+    bool escrita;                 ///< A thread tem a vez de escrita (arquivo::mEscrita)
+    int raiz;                     ///< Caminhos da thread que mantêm arquivo::mRaiz travada
+    vector<travaThread> travas;   ///< Quadros travados pela thread
+#ifdef ESTATISTICAS
+    contadoresOperacao *estat;    ///< Contadores da operação em andamento (NULL fora de uma)
+#endif
+};
+
+thread_local estadoThread minhaThread;  ///< Estado da thread atual
+
+#ifdef ESTATISTICAS
+/// Soma n ao contador c da operação em andamento na thread (nada fora de uma operação)
+#define CONTAR(c, n) do { \
+        if (minhaThread.estat) minhaThread.estat->valor[c].fetch_add((n), memory_order_relaxed); \
+    } while (0)
+
+/**
+ * @struct cronometroES
+ * @brief Soma a CONT_NS_ES o tempo entre a criação e a destruição
+ */
+struct cronometroES {
+    chrono::steady_clock::time_point inicio = chrono::steady_clock::now();  ///< Início da chamada
+    ~cronometroES() {
+        CONTAR(CONT_NS_ES, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicio).count());
+    }
+};
+#define MEDIR_ES() cronometroES cronometroEs_
+#else
+#define CONTAR(c, n) do {} while (0)
+#define MEDIR_ES() do {} while (0)
+#endif
+
+#define FILA_ASSINCRONA 64   ///< Leituras em voo no io_uring (profundidade da fila)
+#define THREADS_LEITURA 4    ///< Threads de leitura quando o io_uring não está disponível
+#define LOTE_MINIMO_THREADS 2 ///< Lotes até este tamanho são lidos sem acordar as threads de leitura
+
+bool permitirIoUring = true;  ///< false força as threads de leitura (--sem-io-uring)
+
+/**
+ * @struct pedidoLeitura
+ * @brief Uma leitura de um lote entregue ao leitorAssincrono
+ */
+struct pedidoLeitura {
+    void *destino;  ///< Onde os bytes devem ser colocados
+    size_t tam;     ///< Quantidade de bytes
+    off_t pos;      ///< Deslocamento no arquivo
+    ssize_t lidos;  ///< Bytes efetivamente lidos (preenchido pelo leitor)
+};
+
+/**
+ * @struct leitorAssincrono
+ * @brief Leitor de lotes de páginas com várias leituras em voo
+ *
+ * Com io_uring (chamado direto pelas syscalls, sem a liburing), os
+ * pedidos de um lote vão para o anel de submissão e são atendidos pelo
+ * núcleo em paralelo, até FILA_ASSINCRONA de cada vez. Onde o io_uring
+ * não existe ou é bloqueado, THREADS_LEITURA threads fazem os pread do
+ * lote junto com a thread que o pediu. Um lote por vez (mLote): o anel
+ * não aceita submissões de várias threads ao mesmo tempo.
+ */
+struct leitorAssincrono {
+    int fd = -1;                    ///< Arquivo lido
+    mutex mLote;                    ///< Um lote em andamento por vez
+
+    int anel = -1;                  ///< Descritor do io_uring (-1 se não usado)
+    void *mapaSq = MAP_FAILED;      ///< Anel de submissão mapeado
+    void *mapaCq = MAP_FAILED;      ///< Anel de conclusão mapeado (pode ser o mesmo)
+    size_t tamSq = 0, tamCq = 0;    ///< Tamanhos dos mapeamentos dos anéis
+    io_uring_sqe *sqes = NULL;      ///< Entradas de submissão
+    size_t tamSqes = 0;             ///< Tamanho do mapeamento das entradas
+    unsigned *sqCauda = NULL, *sqMascara = NULL, *sqVetor = NULL;  ///< Campos do anel de submissão
+    unsigned *cqCabeca = NULL, *cqCauda = NULL, *cqMascara = NULL; ///< Campos do anel de conclusão
+    io_uring_cqe *cqes = NULL;      ///< Entradas de conclusão
+    unsigned entradas = 0;          ///< Tamanho do anel de submissão
+
+    vector<thread> threads;         ///< Threads da alternativa sem io_uring
+    mutex m;                        ///< Protege o lote entregue às threads
+    condition_variable cvTrabalho;  ///< Acorda as threads quando há lote
+    condition_variable cvFeito;     ///< Acorda quem espera o fim do lote
+    pedidoLeitura **lote = NULL;    ///< Pedidos do lote em andamento
+    size_t quantLote = 0;           ///< Pedidos do lote
+    size_t proximo = 0;             ///< Próximo pedido ainda não iniciado
+    size_t feitos = 0;              ///< Pedidos concluídos
+    bool encerrar = false;          ///< As threads devem terminar
+};
+
+/**
+ * @brief Faz um pedido inteiro com pread (short reads só param no fim do arquivo)
+ */
+void lerPedido(int fd, pedidoLeitura &p) {
+    p.lidos = 0;
+    while ((size_t)p.lidos < p.tam) {
+        ssize_t n = pread(fd, (char*)p.destino + p.lidos, p.tam - p.lidos, p.pos + p.lidos);
+        if (n <= 0) break;
+        p.lidos += n;
+    }
+}
+
+/**
+ * @brief Laço de uma thread de leitura: pega pedidos do lote até o encerramento
+ */
+void trabalharLeitura(leitorAssincrono &l) {
+    unique_lock<mutex> trava(l.m);
+    while (true) {
+        l.cvTrabalho.wait(trava, [&l] { return l.encerrar || l.proximo < l.quantLote; });
+        if (l.encerrar) return;
+        pedidoLeitura &p = *l.lote[l.proximo++];
+        trava.unlock();
+        lerPedido(l.fd, p);
+        trava.lock();
+        if (++l.feitos == l.quantLote) l.cvFeito.notify_all();
+    }
+}
+
+/**
+ * @brief Cria o io_uring e mapeia os seus anéis
+ * @return false se o núcleo não oferece ou não permite o io_uring
+ */
+bool criarAnel(leitorAssincrono &l) {
+#ifdef __NR_io_uring_setup
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, FILA_ASSINCRONA, &p);
+    if (fd < 0) return false;
+    l.anel = fd;
+    l.entradas = p.sq_entries;
+    l.tamSq = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    l.tamCq = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+    bool unico = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (unico) l.tamSq = l.tamCq = std::max(l.tamSq, l.tamCq);
+    l.mapaSq = mmap(NULL, l.tamSq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (l.mapaSq == MAP_FAILED) return false;
+    l.mapaCq = unico ? l.mapaSq
+                     : mmap(NULL, l.tamCq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (l.mapaCq == MAP_FAILED) return false;
+    l.tamSqes = p.sq_entries*sizeof(io_uring_sqe);
+    void *sqes = mmap(NULL, l.tamSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    l.sqes = (io_uring_sqe*)sqes;
+
+    char *sq = (char*)l.mapaSq, *cq = (char*)l.mapaCq;
+    l.sqCauda = (unsigned*)(sq + p.sq_off.tail);
+    l.sqMascara = (unsigned*)(sq + p.sq_off.ring_mask);
+    l.sqVetor = (unsigned*)(sq + p.sq_off.array);
+    l.cqCabeca = (unsigned*)(cq + p.cq_off.head);
+    l.cqCauda = (unsigned*)(cq + p.cq_off.tail);
+    l.cqMascara = (unsigned*)(cq + p.cq_off.ring_mask);
+    l.cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+#else
+    (void)l;
+    return false;
+#endif
+}
+
+/**
+ * @brief Desfaz o io_uring e encerra as threads de leitura
+ * @param l Leitor (pode nunca ter sido iniciado)
+ */
+void encerrarLeitor(leitorAssincrono &l) {
+    if (!l.threads.empty()) {
+        {
+            lock_guard<mutex> trava(l.m);
+            l.encerrar = true;
+        }
+        l.cvTrabalho.notify_all();
+        for (size_t k = 0; k < l.threads.size(); k++) l.threads[k].join();
+        l.threads.clear();
+    }
+    if (l.sqes) munmap(l.sqes, l.tamSqes);
+    if (l.mapaCq != MAP_FAILED && l.mapaCq != l.mapaSq) munmap(l.mapaCq, l.tamCq);
+    if (l.mapaSq != MAP_FAILED) munmap(l.mapaSq, l.tamSq);
+    if (l.anel != -1) close(l.anel);
+    l.anel = -1;
+    l.sqes = NULL;
+    l.mapaSq = l.mapaCq = MAP_FAILED;
+    l.encerrar = false;
+    l.fd = -1;
+}
+
+/**
+ * @brief Prepara o leitor para um arquivo
+ * @param l Leitor
+ * @param fd Arquivo a ser lido
+ *
+ * Tenta o io_uring (se permitirIoUring) e, se não conseguir, cria as
+ * threads de leitura.
+ */
+void iniciarLeitor(leitorAssincrono &l, int fd) {
+    encerrarLeitor(l);
+    l.fd = fd;
+    if (permitirIoUring && criarAnel(l)) return;
+    encerrarLeitor(l);
+    l.fd = fd;
+    for (int k = 0; k < THREADS_LEITURA; k++) l.threads.push_back(thread(trabalharLeitura, std::ref(l)));
+}
+
+/**
+ * @brief Atende um lote pelo io_uring
+ * @param l Leitor com o anel criado (e mLote travado)
+ * @param p Pedidos
+ * @param n Quantidade de pedidos
+ *
+ * Mantém até entradas pedidos em voo: a cada io_uring_enter submete o que
+ * couber e espera ao menos uma conclusão. Um pedido que volta com erro ou
+ * incompleto é terminado com pread, o que também cobre o fim do arquivo.
+ */
+void lerAnel(leitorAssincrono &l, pedidoLeitura *p, size_t n) {
+#ifdef __NR_io_uring_setup
+    size_t enviados = 0, concluidos = 0;
+    unsigned naoSubmetidos = 0;  // Entradas já no anel que o núcleo ainda não aceitou
+    while (concluidos < n) {
+        unsigned cauda = *l.sqCauda;
+        while (enviados < n && enviados - concluidos < l.entradas) {
+            unsigned k = cauda & *l.sqMascara;
+            io_uring_sqe &e = l.sqes[k];
+            memset(&e, 0, sizeof(e));
+            e.opcode = IORING_OP_READ;
+            e.fd = l.fd;
+            e.addr = (unsigned long long)(uintptr_t)p[enviados].destino;
+            e.len = p[enviados].tam;
+            e.off = p[enviados].pos;
+            e.user_data = enviados;
+            l.sqVetor[k] = k;
+            cauda++;
+            naoSubmetidos++;
+            enviados++;
+        }
+        __atomic_store_n(l.sqCauda, cauda, __ATOMIC_RELEASE);
+        long r = syscall(__NR_io_uring_enter, l.anel, naoSubmetidos, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r >= 0) naoSubmetidos -= std::min((unsigned)r, naoSubmetidos);
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            cerr << "Erro: falha no io_uring ao ler pagina.dat!\n";
+            exit(1);
+        }
+        unsigned cabeca = *l.cqCabeca;
+        while (cabeca != __atomic_load_n(l.cqCauda, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe &c = l.cqes[cabeca & *l.cqMascara];
+            pedidoLeitura &q = p[c.user_data];
+            if (c.res >= 0 && (size_t)c.res == q.tam) q.lidos = c.res;
+            else lerPedido(l.fd, q);
+            cabeca++;
+            concluidos++;
+        }
+        __atomic_store_n(l.cqCabeca, cabeca, __ATOMIC_RELEASE);
+    }
+#else
+    (void)l; (void)p; (void)n;
+#endif
+}
+
+/**
+ * @brief Atende um lote de leituras, com várias em voo ao mesmo tempo
+ * @param l Leitor iniciado
+ * @param p Pedidos (lidos recebe os bytes lidos de cada um)
+ * @param n Quantidade de pedidos
+ *
+ * Só retorna depois de todos os pedidos concluídos.
+ */
+void lerLote(leitorAssincrono &l, pedidoLeitura *p, size_t n) {
+    for (size_t k = 0; k < n; k++) p[k].lidos = -1;
+    lock_guard<mutex> travaLote(l.mLote);
+    if (l.anel != -1) {
+        lerAnel(l, p, n);
+        return;
+    }
+
+    // O que já está no cache do sistema é lido sem esperar o disco (e sem
+    // acordar as threads); só o resto vai para as threads de leitura
+    vector<pedidoLeitura*> resto;
+    for (size_t k = 0; k < n; k++) {
+#ifdef RWF_NOWAIT
+        iovec v = {p[k].destino, p[k].tam};
+        if (preadv2(l.fd, &v, 1, p[k].pos, RWF_NOWAIT) == (ssize_t)p[k].tam) {
+            p[k].lidos = p[k].tam;
+            continue;
+        }
+#endif
+        resto.push_back(&p[k]);
+    }
+
+    // Poucos pedidos não pagam a troca de contexto para as threads
+    if (resto.size() <= LOTE_MINIMO_THREADS) {
+        for (size_t k = 0; k < resto.size(); k++) lerPedido(l.fd, *resto[k]);
+        return;
+    }
+
+    n = resto.size();
+    unique_lock<mutex> trava(l.m);
+    l.lote = resto.data();
+    l.quantLote = n;
+    l.proximo = l.feitos = 0;
+    for (size_t k = 1; k < n && k <= l.threads.size(); k++) l.cvTrabalho.notify_one();
+
+    // Quem pediu o lote também lê, em vez de só esperar
+    while (l.proximo < n) {
+        pedidoLeitura &q = *resto[l.proximo++];
+        trava.unlock();
+        lerPedido(l.fd, q);
+        trava.lock();
+        l.feitos++;
+    }
+    l.cvFeito.wait(trava, [&l, n] { return l.feitos == n; });
+    l.lote = NULL;
+    l.quantLote = l.proximo = l.feitos = 0;
+}
+
+#define BITS_POR_CHAVE 10             ///< Bits do filtro de Bloom por chave prevista
+#define FILTRO_MIN 1024               ///< Menor quantidade de chaves prevista pelo filtro
+#define ASSINATURA_FILTRO 0x544c4642  ///< Início do arquivo do filtro ("BFLT")
+
+/**
+ * @struct tabelaFiltro
+ * @brief Bits de um filtro de Bloom, com o tamanho com que foram criados
+ */
+struct tabelaFiltro {
+    long long blocos;                        ///< Quantidade de blocos
+    unique_ptr<atomic<unsigned>[]> palavras; ///< 8 palavras por bloco
+};
+
+/**
+ * @struct filtroBloom
+ * @brief Filtro de Bloom das chaves do arquivo, dividido em blocos
+ *
+ * Cada chave liga um bit em cada uma das 8 palavras de um único bloco,
+ * escolhido pelo hash, então um teste lê só 32 bytes. Não há falso
+ * negativo: uma chave ausente do filtro não está no arquivo. A remoção
+ * não desliga bits (outras chaves podem usá-los), então uma chave
+ * removida continua contando em chaves até o filtro ser refeito. As
+ * palavras são atômicas porque leitores consultam o filtro enquanto o
+ * escritor liga bits.
+ *
+ * Refeito durante a execução (terminarEscrita), o filtro ganha uma tabela
+ * nova, publicada em atual. A substituída fica em tabelas até o arquivo
+ * ser fechado, porque um leitor pode ainda estar consultando-a.
+ */
+struct filtroBloom {
+    atomic<tabelaFiltro*> atual{NULL};        ///< Tabela consultada (NULL se não há filtro)
+    vector<unique_ptr<tabelaFiltro>> tabelas; ///< A atual e as já substituídas
+    long long capacidade = 0;   ///< Chaves previstas no dimensionamento
+    long long chaves = 0;       ///< Chaves acrescentadas desde a construção
+};
+
+/// Multiplicadores que escolhem o bit de cada palavra do bloco
+const unsigned SAIS_FILTRO[8] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+/**
+ * @brief Espalha os bits de uma chave (finalização do MurmurHash3)
+ * @param chave Chave
+ */
+unsigned long long hashChave(tipoChave chave) {
+    unsigned long long x = tracos::bits(chave);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * @brief Cria uma tabela zerada para o filtro, ainda sem publicá-la
+ * @param f Filtro que guarda a tabela
+ * @param blocos Quantidade de blocos
+ * @return Tabela criada, a ser publicada com f.atual
+ */
+tabelaFiltro *novaTabela(filtroBloom &f, long long blocos) {
+    tabelaFiltro *t = new tabelaFiltro;
+    f.tabelas.emplace_back(t);
+    t->blocos = blocos;
+    t->palavras.reset(new atomic<unsigned>[8*blocos]);
+    for (long long k = 0; k < 8*blocos; k++) t->palavras[k].store(0, memory_order_relaxed);
+    return t;
+}
+
+/**
+ * @brief Cria um filtro vazio
+ * @param f Filtro (ainda não consultado por outras threads)
+ * @param chaves Chaves que o arquivo tem agora
+ *
+ * O filtro é dimensionado para o dobro das chaves, para que o arquivo
+ * possa crescer antes de o filtro precisar ser refeito.
+ */
+void iniciarFiltro(filtroBloom &f, long long chaves) {
+    f.capacidade = 2*chaves + FILTRO_MIN;
+    f.atual.store(novaTabela(f, (f.capacidade*BITS_POR_CHAVE + 255) / 256), memory_order_release);
+    f.chaves = 0;
+}
+
+/**
+ * @brief Coloca no lugar de um filtro outro já preenchido
+ * @param f Filtro em uso, consultado pelos leitores
+ * @param novo Filtro montado pela thread atual (fica sem tabelas)
+ *
+ * Os leitores passam a consultar a tabela nova na próxima chave; a antiga
+ * continua em f.tabelas para quem ainda está nela.
+ */
+void trocarFiltro(filtroBloom &f, filtroBloom &novo) {
+    for (size_t k = 0; k < novo.tabelas.size(); k++) f.tabelas.push_back(move(novo.tabelas[k]));
+    novo.tabelas.clear();
+    f.capacidade = novo.capacidade;
+    f.chaves = novo.chaves;
+    f.atual.store(novo.atual.load(memory_order_relaxed), memory_order_release);
+    novo.atual.store(NULL, memory_order_relaxed);
+}
+
+/**
+ * @brief Bloco do filtro em que uma chave cai
+ * @param t Tabela do filtro
+ * @param h Hash da chave
+ */
+atomic<unsigned> *blocoFiltro(const tabelaFiltro &t, unsigned long long h) {
+    return &t.palavras[8*(long long)((h >> 32)*(unsigned long long)t.blocos >> 32)];
+}
+
+/**
+ * @brief Acrescenta uma chave ao filtro
+ * @param f Filtro
+ * @param chave Chave inserida (ou que pode vir a ser)
+ *
+ * Chamada pelo escritor antes de a chave aparecer na folha, para que um
+ * leitor que encontraria a chave nunca seja barrado pelo filtro. Só conta
+ * em chaves se ligou algum bit: regravar uma chave que já está no filtro
+ * não o enche.
+ */
+void acrescentarFiltro(filtroBloom &f, tipoChave chave) {
+    const tabelaFiltro *t = f.atual.load(memory_order_relaxed);
+    if (t == NULL) return;
+    unsigned long long h = hashChave(chave);
+    atomic<unsigned> *bloco = blocoFiltro(*t, h);
+    bool novo = false;
+    for (int j = 0; j < 8; j++) {
+        unsigned bit = 1u << ((unsigned)h*SAIS_FILTRO[j] >> 27);
+        if (!(bloco[j].fetch_or(bit, memory_order_relaxed) & bit)) novo = true;
+    }
+    if (novo) f.chaves++;
+}
+
+/**
+ * @brief Diz se uma chave pode estar no arquivo
+ * @param f Filtro
+ * @param chave Chave procurada
+ * @return false só se a chave com certeza não está no arquivo (sempre true sem filtro)
+ */
+bool talvezContenha(const filtroBloom &f, tipoChave chave) {
+    const tabelaFiltro *t = f.atual.load(memory_order_acquire);
+    if (t == NULL) return true;
+    unsigned long long h = hashChave(chave);
+    atomic<unsigned> *bloco = blocoFiltro(*t, h);
+    for (int j = 0; j < 8; j++) {
+        if (!(bloco[j].load(memory_order_relaxed) & 1u << ((unsigned)h*SAIS_FILTRO[j] >> 27))) return false;
+    }
+    return true;
+}
+
+#define ALOCACAO_PILHA 0     ///< Reaproveita a última página liberada (LIFO)
+#define ALOCACAO_ENDERECO 1  ///< Usa a página livre mais próxima de uma página indicada
+
+/**
+ * @struct arquivo
+ * @brief Arquivo de dados aberto, com cabeçalho residente e buffer pool
+ *
+ * Todas as operações acessam as páginas por meio de fixar/desafixar. As
+ * páginas alteradas ficam em memória e só são gravadas quando o quadro é
+ * substituído (política CLOCK) ou quando o cache é descarregado. O
+ * cabeçalho fica sempre em memória e é gravado apenas no descarregamento.
+ *
+ * Concorrência (somente com o buffer pool): várias threads podem pesquisar
+ * ao mesmo tempo enquanto uma escreve. Cada quadro tem uma trava de
+ * leitura/escrita, adquirida por fixar e liberada por desafixar; a E/S usa
+ * pread/pwrite, que não dependem de uma posição compartilhada. Leitores
+ * descem com acoplamento de travas (fixam o filho antes de soltar o pai);
+ * o escritor desce com travas exclusivas e solta os ancestrais assim que
+ * encontra uma página que não vai se dividir nem se fundir (crabbing).
+ * As escritas são serializadas por mEscrita até o bloco entrar no log,
+ * porque cada bloco guarda a imagem de um cabeçalho único.
+ *
+ * Pesquisas e cursores tentam antes uma leitura otimista, sem fixar nem
+ * travar nada: cada quadro tem um contador de versão, ímpar enquanto o
+ * quadro está travado para escrita ou sendo trocado de página; o leitor
+ * anota a versão, lê a página e confere no fim se a versão é a mesma.
+ */
+struct arquivo {
+    fstream f;                      ///< Arquivo pagina.dat
+    pagina cab;                     ///< Cabeçalho (página 0), sempre residente
+    bool cabSujo;                   ///< Cabeçalho alterado desde a última gravação
+    vector<quadro> quadros;         ///< Controle de cada quadro
+    vector<pagina> memoria;         ///< Conteúdo da página de cada quadro
+    unordered_map<int, int> tabela; ///< Página -> quadro em que está carregada
+    int relogio;                    ///< Ponteiro do CLOCK
+    mutex mCache;                   ///< Protege tabela, quadros e relógio
+    condition_variable cvCarga;     ///< Acorda quem espera um quadro em carregamento (com mCache)
+    unique_ptr<shared_mutex[]> travas; ///< Trava de conteúdo de cada quadro
+    shared_mutex mRaiz;             ///< Protege raiz e altura durante a descida
+    mutex mEscrita;                 ///< Uma operação de escrita por vez
+    unique_ptr<atomic<unsigned long long>[]> versao; ///< Versão de cada quadro (ímpar durante alteração)
+    unique_ptr<atomic<int>[]> paginaQuadro;         ///< Página de cada quadro, lida sem mCache
+    unique_ptr<atomic<int>[]> dica;                 ///< Página -> quadro provável (mapeamento direto)
+    int mascaraDica;                ///< Tamanho de dica menos um (potência de 2)
+    atomic<long long> raizAltura;   ///< Raiz e altura publicadas para a leitura otimista
+    atomic<unsigned> mudancas;      ///< Páginas movidas pela compactação (ímpar durante a mudança)
+
+    char *mapa;                     ///< Arquivo mapeado em memória (NULL se usa o cache)
+    size_t tamMapa;                 ///< Tamanho do mapeamento em bytes
+    int fd;                         ///< Descritor usado pelo mapeamento
+    int sujoIni, sujoFim;           ///< Intervalo de páginas alteradas desde o último msync
+
+    int fdDados;                    ///< Descritor de pagina.dat (pread/pwrite do cache)
+    int blocoDisco;                 ///< Bloco do sistema de arquivos (0 se o fim de uma página não pode virar buraco)
+    int fdLog;                      ///< Log de escrita antecipada (-1 se desligado)
+    leitorAssincrono leitor;        ///< Leituras em lote de pagina.dat (io_uring ou threads)
+    long long tamLog;               ///< Bytes no log desde o último checkpoint
+    vector<int> alteradas;          ///< Páginas alteradas pela operação em andamento
+    mutex mLog;                     ///< Protege o estado do grupo de confirmação
+    condition_variable cvLog;       ///< Acorda quem espera o fsync do seu bloco
+    vector<char> bufLog;            ///< Blocos anexados ainda não gravados
+    long long lsnAnexado;           ///< Número do último bloco anexado
+    long long lsnDuravel;           ///< Número do último bloco já sincronizado
+    bool gravandoLog;               ///< Há uma gravação do grupo em andamento
+
+    bool mapaLivres;                ///< livresOrdem e anteriorLivre refletem a lista de livres
+    set<int> livresOrdem;           ///< Páginas da lista de livres, em ordem crescente
+    unordered_map<int, int> anteriorLivre; ///< Página livre -> anterior na lista (-1 na cabeça)
+    int folhasOrdenadas;            ///< Folhas já colocadas nas páginas 1, 2, ... pela compactação
+    int alocacao;                   ///< ALOCACAO_PILHA ou ALOCACAO_ENDERECO
+    long long epoca;                ///< Escritas terminadas (a vez de escrita devolvida) desde a abertura
+    mutex mVersoes;                 ///< Protege instantaneos e versoes
+    multiset<long long> instantaneos; ///< Época de cada instantâneo aberto
+    atomic<int> quantInstantaneos;  ///< Tamanho de instantaneos, lido pelo escritor sem mVersoes
+    unordered_map<int, vector<versaoPagina>> versoes; ///< Imagens anteriores de cada página, da mais antiga à mais nova
+    filtroBloom filtro;             ///< Chaves que podem estar no arquivo (sem filtro, todas)
+    string nomeFiltro;              ///< Arquivo em que o filtro é gravado ao fechar (vazio: não é gravado)
+#ifdef ESTATISTICAS
+    contadoresOperacao estat[TIPOS_ESTAT]; ///< Instrumentação por tipo de operação
+#endif
+
+    atomic<long long> bytesLidos;   ///< Bytes lidos de pagina.dat desde a abertura
+    atomic<long long> bytesGravados; ///< Bytes gravados em pagina.dat e no log desde a abertura
+};
+
+#ifdef ESTATISTICAS
+/**
+ * @struct escopoEstatistica
+ * @brief Marca a operação em andamento na thread, da criação à destruição
+ *
+ * Só a operação mais externa conta: uma operação chamada por outra (como
+ * a remoção feita por uma substituição) soma nos contadores de quem a
+ * chamou.
+ */
+struct escopoEstatistica {
+    bool externa;                                 ///< Não havia operação em andamento
+    chrono::steady_clock::time_point inicio;      ///< Início da operação
+    escopoEstatistica(arquivo &arq, int tipo) : externa(minhaThread.estat == NULL) {
+        if (!externa) return;
+        minhaThread.estat = &arq.estat[tipo];
+        CONTAR(CONT_OPERACOES, 1);
+        inicio = chrono::steady_clock::now();
+    }
+    ~escopoEstatistica() {
+        if (!externa) return;
+        CONTAR(CONT_NS_OPERACAO, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicio).count());
+        minhaThread.estat = NULL;
+    }
+};
+#define ESTATISTICA(arq, tipo) escopoEstatistica escopoEstat_(arq, tipo)
+#else
+#define ESTATISTICA(arq, tipo) do {} while (0)
+#endif
+
+/**
+ * @brief Zera todos os contadores de instrumentação
+ * @param arq Arquivo aberto
+ */
+void zerarEstatisticas(arquivo &arq) {
+#ifdef ESTATISTICAS
+    for (int t = 0; t < TIPOS_ESTAT; t++) {
+        for (int c = 0; c < QUANT_CONT; c++) arq.estat[t].valor[c].store(0, memory_order_relaxed);
+    }
+#else
+    (void)arq;
+#endif
+}
+
+/**
+ * @brief Consulta um contador de instrumentação
+ * @param arq Arquivo aberto
+ * @param tipo Tipo de operação (ESTAT_*)
+ * @param contador Contador (CONT_*)
+ * @return Valor acumulado desde a abertura ou o último zerarEstatisticas
+ *         (sempre zero sem -DESTATISTICAS)
+ */
+long long lerEstatistica(arquivo &arq, int tipo, int contador) {
+#ifdef ESTATISTICAS
+    return arq.estat[tipo].valor[contador].load(memory_order_relaxed);
+#else
+    (void)arq; (void)tipo; (void)contador;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Imprime os contadores em JSON, um objeto por tipo de operação
+ * @param arq Arquivo aberto
+ * @param o Destino
+ */
+void imprimirEstatisticasJson(arquivo &arq, ostream &o) {
+    o << "{";
+    for (int t = 0; t < TIPOS_ESTAT; t++) {
+        o << (t ? ",\n " : "\n ") << "\"" << nomesEstat[t] << "\": {";
+        for (int c = 0; c < QUANT_CONT; c++) {
+            o << (c ? ", " : "") << "\"" << nomesCont[c] << "\": " << lerEstatistica(arq, t, c);
+        }
+        o << "}";
+    }
+    o << "\n}\n";
+}
+
+/**
+ * @brief Imprime os contadores no formato de texto do Prometheus
+ * @param arq Arquivo aberto
+ * @param o Destino
+ *
+ * Cada contador vira a métrica arvore_bplus_<nome>_total, com o tipo de
+ * operação no rótulo "operacao".
+ */
+void imprimirEstatisticasPrometheus(arquivo &arq, ostream &o) {
+    for (int c = 0; c < QUANT_CONT; c++) {
+        o << "# TYPE arvore_bplus_" << nomesCont[c] << "_total counter\n";
+        for (int t = 0; t < TIPOS_ESTAT; t++) {
+            o << "arvore_bplus_" << nomesCont[c] << "_total{operacao=\"" << nomesEstat[t] << "\"} "
+              << lerEstatistica(arq, t, c) << "\n";
+        }
+    }
+}
+
+/**
+ * @struct caminho
+ * @brief Guarda as páginas internas visitadas na descida da raiz até a folha
+ *
+ * Usado pela inserção e pela remoção para propagar divisões e fusões de
+ * páginas em direção à raiz sem precisar reler o índice. As páginas ficam
+ * fixadas no buffer pool até soltarCaminho.
+ */
+struct caminho {
+    int altura;                 ///< Quantidade de níveis internos percorridos
+    int pos[MAX_ALTURA];        ///< Número de cada página interna visitada
+    int ind[MAX_ALTURA];        ///< Índice do filho seguido em cada página
+    pagina *no[MAX_ALTURA];     ///< Página interna visitada (fixada no cache)
+    tipoChave baixo[MAX_ALTURA]; ///< Menor chave que pode estar abaixo de cada página visitada
+    tipoChave alto[MAX_ALTURA]; ///< Limite superior (inclusivo) das chaves abaixo dela
+    bool raiz;                  ///< O caminho começa na raiz (mRaiz travada)
+    pagina *folha;              ///< Folha alcançada (fixada no cache)
+};
+
+#define CAB_FOLHA (6*(int)sizeof(int))  ///< Bytes do cabeçalho da folha, antes das chaves
+#define SLOT_EXCEDENTE 0x8000            ///< Marca, no tamanho do slot, um valor guardado no excedente
+
+/**
+ * @struct slot
+ * @brief Posição e tamanho do valor de um registro da folha
+ */
+struct slot {
+    unsigned short pos;  ///< Início do valor na página
+    unsigned short tam;  ///< Bytes do valor na folha (com SLOT_EXCEDENTE, uma referenciaExcedente)
+};
+
+/**
+ * @struct referenciaExcedente
+ * @brief O que a folha guarda de um valor maior que o limiar
+ */
+struct referenciaExcedente {
+    int comprimento;  ///< Tamanho total do valor
+    int pagina;       ///< Primeira página de excedente
+};
+
+/**
+ * @struct celula
+ * @brief Registro do jeito que está guardado na folha
+ *
+ * Um valor no excedente fica representado pela sua referência, então
+ * divisões, fusões e redistribuições movem registros entre folhas sem
+ * ler nem regravar as páginas de excedente.
+ */
+struct celula {
+    tipoChave chave;  ///< Chave do registro
+    bool excedente;   ///< carga é uma referenciaExcedente
+    string carga;     ///< Bytes guardados na folha
 };
 
 /**
- * @brief Inicializa um novo arquivo para a Árvore B+
- * @param arq Referência para o arquivo já aberto
- * @param n Número máximo de registros que o arquivo pode armazenar
- * 
- * Esta função:
- * 1. Configura o cabeçalho com valores iniciais
- * 2. Inicializa todos os nós como livres
- * 3. Encadeia os nós livres em uma lista
- * 
- * Complexidade: O(n) onde n é o número máximo de registros
- */
-void inicializar(fstream &arq, int n) {
-    celula cab, l;
-    // Posiciona no início do arquivo
-    arq.seekp(0, arq.beg);
+ * @brief Maior quantidade de registros de uma página folha (todos com valor vazio)
+ * @param tamPagina Tamanho da página em bytes
+ */
+constexpr int capacidadeFolha(int tamPagina) {
+    return (tamPagina - CAB_FOLHA) / (sizeof(tipoChave) + sizeof(slot));
+}
+
+/**
+ * @brief Espaço que um registro ocupa na folha: chave, slot e valor
+ * @param tamValor Bytes do valor guardados na folha
+ */
+constexpr int tamanhoRegistro(int tamValor) {
+    return sizeof(tipoChave) + sizeof(slot) + tamValor;
+}
+
+/**
+ * @brief Maior espaço que um registro pode ocupar na folha
+ * @param limiar Limiar do arquivo (cab.cabecalho.limiar)
+ */
+constexpr int registroMaximo(int limiar) {
+    return tamanhoRegistro(std::max(limiar, (int)sizeof(referenciaExcedente)));
+}
+
+/**
+ * @brief Ocupação mínima, em bytes, de uma folha que não é a raiz
+ * @param tamPagina Tamanho da página em bytes
+ * @param limiar Limiar do arquivo (cab.cabecalho.limiar)
+ *
+ * Metade da área da página, menos dois registros máximos de folga: a
+ * divisão e a redistribuição cortam entre dois registros, então cada lado
+ * pode ficar um pouco abaixo da metade.
+ */
+constexpr int minimoFolha(int tamPagina, int limiar) {
+    return (tamPagina - CAB_FOLHA) / 2 - 2*registroMaximo(limiar);
+}
+
+/**
+ * @brief Diz se um limiar serve para o tamanho de página
+ * @param limiar Maior valor guardado na própria folha (bytes)
+ * @param tamPagina Tamanho da página em bytes
+ *
+ * O limiar precisa comportar uma referência ao excedente e deixar pelo
+ * menos oito registros máximos por folha.
+ */
+bool limiarValido(int limiar, int tamPagina) {
+    return limiar >= (int)sizeof(referenciaExcedente) && registroMaximo(limiar) <= (tamPagina - CAB_FOLHA) / 8;
+}
+
+/**
+ * @brief Endereço dos slots de uma folha, logo depois das chaves
+ * @param l Página folha
+ * @param quant Quantidade de registros considerada
+ */
+slot *slotsFolha(pagina &l, int quant) {
+    return (slot*)(l.bytes + CAB_FOLHA + quant*sizeof(tipoChave));
+}
+
+/**
+ * @brief Espaço livre de uma folha, contando o dos valores já removidos
+ * @param l Página folha
+ */
+int espacoLivre(pagina &l) {
+    return l.folha.topo - CAB_FOLHA - l.folha.quant*tamanhoRegistro(0) + l.folha.lixo;
+}
+
+/**
+ * @brief Bytes ocupados pelos registros de uma folha
+ * @param l Página folha
+ * @param tamPagina Tamanho da página em bytes
+ */
+int ocupacaoFolha(pagina &l, int tamPagina) {
+    return tamPagina - CAB_FOLHA - espacoLivre(l);
+}
+
+/**
+ * @brief Espaço que uma célula ocupa na folha
+ */
+int tamanhoCelula(const celula &c) {
+    return tamanhoRegistro(c.carga.size());
+}
+
+/**
+ * @brief Lê o i-ésimo registro de uma folha
+ * @param l Página folha
+ * @param i Índice do registro
+ */
+celula lerCelula(pagina &l, int i) {
+    slot s = slotsFolha(l, l.folha.quant)[i];
+    celula c;
+    c.chave = l.folha.chave[i];
+    c.excedente = (s.tam & SLOT_EXCEDENTE) != 0;
+    c.carga.assign(l.bytes + s.pos, s.tam & ~SLOT_EXCEDENTE);
+    CONTAR(CONT_CELULAS_LIDAS, 1);
+    return c;
+}
+
+/**
+ * @brief Lê o i-ésimo registro de uma folha que pode estar sendo alterada
+ * @param l Página folha
+ * @param quant Quantidade de registros, lida uma única vez
+ * @param i Índice do registro
+ * @param tamPagina Tamanho da página em bytes
+ * @param c Recebe o registro
+ * @return false se o slot aponta para fora da página
+ *
+ * Usada pela leitura otimista: o resultado só vale se a versão da página
+ * for confirmada depois, mas a cópia nunca sai da página.
+ */
+bool copiarCelula(pagina &l, int quant, int i, int tamPagina, celula &c) {
+    slot s;
+    memcpy(&s, &slotsFolha(l, quant)[i], sizeof(s));
+    int tam = s.tam & ~SLOT_EXCEDENTE;
+    if (s.pos < CAB_FOLHA || s.pos + tam > tamPagina) return false;
+    c.chave = l.folha.chave[i];
+    c.excedente = (s.tam & SLOT_EXCEDENTE) != 0;
+    c.carga.assign(l.bytes + s.pos, tam);
+    CONTAR(CONT_CELULAS_LIDAS, 1);
+    return true;
+}
+
+/**
+ * @brief Acrescenta a um vetor registros consecutivos de uma folha
+ * @param l Página folha
+ * @param i Índice do primeiro registro
+ * @param n Quantidade de registros
+ * @param regs Vetor que recebe os registros
+ */
+void lerCelulas(pagina &l, int i, int n, vector<celula> &regs) {
+    for (int k = 0; k < n; k++) regs.push_back(lerCelula(l, i + k));
+}
+
+/**
+ * @brief Regrava uma folha com os registros dados, na ordem
+ * @param l Página folha (tipo, next e prev são mantidos)
+ * @param tamPagina Tamanho da página em bytes
+ * @param c Registros, que precisam caber na página
+ * @param n Quantidade de registros
+ *
+ * Os valores são gravados juntos a partir do fim da página, sem espaço
+ * perdido entre eles.
+ */
+void montarFolha(pagina &l, int tamPagina, const celula *c, int n) {
+    slot *s = slotsFolha(l, n);
+    int topo = tamPagina;
+    for (int k = 0; k < n; k++) {
+        int tam = c[k].carga.size();
+        topo -= tam;
+        l.folha.chave[k] = c[k].chave;
+        memcpy(l.bytes + topo, c[k].carga.data(), tam);
+        s[k].pos = topo;
+        s[k].tam = tam | (c[k].excedente ? SLOT_EXCEDENTE : 0);
+    }
+    l.folha.quant = n;
+    l.folha.topo = topo;
+    l.folha.lixo = 0;
+    CONTAR(CONT_CELULAS_GRAVADAS, n);
+}
+
+/**
+ * @brief Insere um registro na posição i de uma folha
+ * @param l Página folha, com espacoLivre suficiente para o registro
+ * @param tamPagina Tamanho da página em bytes
+ * @param i Posição do novo registro
+ * @param c Registro
+ *
+ * Só as chaves e os slots à direita de i são deslocados; os valores não
+ * saem do lugar. Se o espaço livre contínuo não basta, os valores são
+ * reagrupados antes (montarFolha), recuperando o espaço dos removidos.
+ *
+ * Complexidade: O(B) bytes movidos no pior caso
+ */
+void inserirCelula(pagina &l, int tamPagina, int i, const celula &c) {
+    int tam = c.carga.size();
+    if (l.folha.topo - CAB_FOLHA - (l.folha.quant + 1)*tamanhoRegistro(0) < tam) {
+        vector<celula> regs;
+        lerCelulas(l, 0, l.folha.quant, regs);
+        montarFolha(l, tamPagina, regs.data(), regs.size());
+    }
+    int q = l.folha.quant;
+    slot *antes = slotsFolha(l, q), *depois = slotsFolha(l, q + 1);
+    memmove(depois + i + 1, antes + i, (q - i)*sizeof(slot));
+    memmove(depois, antes, i*sizeof(slot));
+    memmove(&l.folha.chave[i + 1], &l.folha.chave[i], (q - i)*sizeof(tipoChave));
+    l.folha.chave[i] = c.chave;
+    l.folha.topo -= tam;
+    memcpy(l.bytes + l.folha.topo, c.carga.data(), tam);
+    depois[i].pos = l.folha.topo;
+    depois[i].tam = tam | (c.excedente ? SLOT_EXCEDENTE : 0);
+    l.folha.quant++;
+    CONTAR(CONT_CELULAS_GRAVADAS, 1);
+}
+
+/**
+ * @brief Retira registros consecutivos de uma folha
+ * @param l Página folha
+ * @param i Índice do primeiro registro
+ * @param n Quantidade de registros
+ *
+ * Os valores ficam onde estão e passam a contar como lixo, recuperado na
+ * próxima vez que a folha for regravada.
+ */
+void removerCelulas(pagina &l, int i, int n) {
+    if (n <= 0) return;
+    int q = l.folha.quant;
+    slot *antes = slotsFolha(l, q), *depois = slotsFolha(l, q - n);
+    for (int k = i; k < i + n; k++) l.folha.lixo += antes[k].tam & ~SLOT_EXCEDENTE;
+    memmove(&l.folha.chave[i], &l.folha.chave[i + n], (q - i - n)*sizeof(tipoChave));
+    memmove(depois, antes, i*sizeof(slot));
+    memmove(depois + i, antes + i + n, (q - i - n)*sizeof(slot));
+    l.folha.quant = q - n;
+    CONTAR(CONT_CELULAS_GRAVADAS, n);
+}
+
+/**
+ * @brief Referência ao excedente guardada em uma célula
+ * @param c Célula com excedente
+ */
+referenciaExcedente lerReferencia(const celula &c) {
+    referenciaExcedente r;
+    memcpy(&r, c.carga.data(), sizeof(r));
+    return r;
+}
+
+/**
+ * @brief Divide registros em partes de ocupação parecida
+ * @param regs Registros, na ordem
+ * @param partes Quantidade de partes
+ * @return Índice do início de cada parte, seguido de regs.size()
+ *
+ * Cada corte fica no primeiro registro que alcança a fração seguinte dos
+ * bytes, então cada parte difere da média em menos de um registro.
+ */
+vector<size_t> dividirCelulas(const vector<celula> &regs, int partes) {
+    long long total = 0;
+    for (size_t k = 0; k < regs.size(); k++) total += tamanhoCelula(regs[k]);
+    vector<size_t> cortes(1, 0);
+    long long acumulado = 0;
+    for (size_t k = 0; k < regs.size() && (int)cortes.size() < partes; k++) {
+        acumulado += tamanhoCelula(regs[k]);
+        if (acumulado*partes >= total*(long long)cortes.size() && k + 1 < regs.size()) cortes.push_back(k + 1);
+    }
+    cortes.push_back(regs.size());
+    return cortes;
+}
+
+#define ALCANCE_DELTA ((1ULL << 8*sizeof(tipoDelta)) - 1)  ///< Maior distância entre a base e um separador compacto
+#define SINAL_DELTA (1ULL << (8*sizeof(tipoDelta) - 1))    ///< Bit de sinal de tipoDelta
+
+/**
+ * @brief Quantidade máxima de chaves separadoras de uma página interna
+ * @param tamPagina Tamanho da página em bytes
+ *
+ * É a capacidade com os separadores inteiros, que toda página comporta;
+ * as ocupações mínimas da remoção e da carga em massa partem dela.
+ */
+constexpr int capacidadeInterna(int tamPagina) {
+    return (tamPagina - 4*sizeof(int)) / (sizeof(tipoChave) + sizeof(int)) - 1;
+}
+
+/**
+ * @brief Quantidade máxima de chaves separadoras de uma página interna compacta
+ * @param tamPagina Tamanho da página em bytes
+ *
+ * Descontada a base, cada separador ocupa sizeof(tipoDelta) bytes em vez
+ * de sizeof(tipoChave). A metade dela (uma divisão) sempre cabe em
+ * capacidadeInterna.
+ */
+constexpr int capacidadeCompacta(int tamPagina) {
+    return (tamPagina - 4*sizeof(int) - sizeof(tipoChave)) / (sizeof(tipoDelta) + sizeof(int)) - 1;
+}
+
+/**
+ * @brief Capacidade de uma página interna no seu formato
+ * @param compacta Campo compacta da página
+ * @param tamPagina Tamanho da página em bytes
+ */
+int capacidadePagina(int compacta, int tamPagina) {
+    return compacta ? capacidadeCompacta(tamPagina) : capacidadeInterna(tamPagina);
+}
+
+/**
+ * @brief Capacidade de uma página interna no seu formato
+ * @param no Página interna
+ * @param tamPagina Tamanho da página em bytes
+ */
+int capacidadePagina(pagina &no, int tamPagina) {
+    return capacidadePagina(no.interna.compacta, tamPagina);
+}
+
+/**
+ * @brief Diz se uma página interna pode ser compacta
+ * @param baixo Menor chave que pode estar abaixo da página
+ * @param alto Maior chave que pode estar abaixo da página
+ *
+ * Todos os separadores que a página pode vir a receber (divisões e
+ * redistribuições dos filhos) estão entre os seus limites, então com a
+ * base em baixo nenhum deles fica fora do alcance das distâncias.
+ */
+bool cabeCompacta(tipoChave baixo, tipoChave alto) {
+    return tracos::distancia(baixo, alto) <= ALCANCE_DELTA;
+}
+
+/**
+ * @brief Coluna de distâncias de uma página interna compacta
+ * @param no Página interna compacta
+ *
+ * Como na coluna de chaves, a posição 0 não é usada.
+ */
+tipoDelta *deltasInterna(pagina &no) {
+    return (tipoDelta*)&no.interna.chave[1];
+}
+
+/**
+ * @brief Distância de uma chave até a base, no formato guardado
+ * @param chave Chave entre base e base + ALCANCE_DELTA
+ * @param base Base da página
+ *
+ * O bit de sinal é invertido para que a ordem das distâncias sem sinal
+ * seja a dos valores com sinal, comparados pelas buscas vetoriais.
+ */
+tipoDelta codificarDelta(tipoChave chave, tipoChave base) {
+    return (tipoDelta)(tracos::distancia(base, chave) ^ SINAL_DELTA);
+}
+
+/**
+ * @brief i-ésima chave separadora de uma página interna
+ * @param no Página interna
+ * @param i Índice do separador (1 a quant)
+ */
+tipoChave separadorInterna(pagina &no, int i) {
+    if (!no.interna.compacta) return no.interna.chave[i];
+    typedef make_unsigned<tipoDelta>::type semSinal;
+    unsigned long long d = (semSinal)deltasInterna(no)[i] ^ SINAL_DELTA;
+    return tracos::deslocar(no.interna.chave[0], d);
+}
+
+/**
+ * @brief Grava a i-ésima chave separadora de uma página interna
+ * @param no Página interna
+ * @param i Índice do separador (1 a quant)
+ * @param chave Separador, dentro dos limites da página
+ */
+void escreverSeparador(pagina &no, int i, tipoChave chave) {
+    if (no.interna.compacta) deltasInterna(no)[i] = codificarDelta(chave, no.interna.chave[0]);
+    else no.interna.chave[i] = chave;
+}
+
+/**
+ * @brief Número do i-ésimo filho de uma página interna
+ * @param no Página interna
+ * @param tamPagina Tamanho da página em bytes
+ * @param i Índice do filho (0 a quant)
+ *
+ * Os filhos ficam no fim da página, do último byte para trás, então a
+ * posição deles não depende do formato dos separadores.
+ */
+int &filhoInterna(pagina &no, int tamPagina, int i) {
+    return ((int*)(no.bytes + tamPagina))[-1 - i];
+}
+
+/**
+ * @brief Monta o i-ésimo par (separador, filho) de uma página interna
+ * @param no Página interna
+ * @param tamPagina Tamanho da página em bytes
+ * @param i Índice do par
+ */
+entrada entradaInterna(pagina &no, int tamPagina, int i) {
+    entrada e = {i ? separadorInterna(no, i) : 0, filhoInterna(no, tamPagina, i)};
+    return e;
+}
+
+/**
+ * @brief Grava pares (separador, filho) consecutivos de uma página interna
+ * @param no Página interna
+ * @param tamPagina Tamanho da página em bytes
+ * @param i Índice do primeiro par
+ * @param e Pares
+ * @param n Quantidade de pares
+ */
+void escreverEntradas(pagina &no, int tamPagina, int i, const entrada *e, int n) {
+    for (int k = 0; k < n; k++) {
+        if (i + k > 0) escreverSeparador(no, i + k, e[k].chave);
+        filhoInterna(no, tamPagina, i + k) = e[k].filho;
+    }
+}
+
+/**
+ * @brief Copia pares consecutivos de uma página interna para outra (ou dentro da mesma)
+ * @param destino Página que recebe os pares
+ * @param para Índice do primeiro par no destino
+ * @param origem Página de onde vêm os pares (pode ser a própria destino)
+ * @param de Índice do primeiro par na origem
+ * @param n Quantidade de pares
+ * @param tamPagina Tamanho da página em bytes
+ *
+ * Entre páginas do mesmo formato (e mesma base) as colunas são copiadas
+ * de uma vez; senão cada separador é decodificado e regravado.
+ */
+void moverEntradas(pagina &destino, int para, pagina &origem, int de, int n, int tamPagina) {
+    if (n <= 0) return;
+    bool compacta = destino.interna.compacta;
+    if (compacta == (bool)origem.interna.compacta && (!compacta || destino.interna.chave[0] == origem.interna.chave[0])) {
+        if (compacta) memmove(&deltasInterna(destino)[para], &deltasInterna(origem)[de], n*sizeof(tipoDelta));
+        else memmove(&destino.interna.chave[para], &origem.interna.chave[de], n*sizeof(tipoChave));
+    } else {
+        for (int k = 0; k < n; k++) {
+            if (para + k > 0 && de + k > 0) escreverSeparador(destino, para + k, separadorInterna(origem, de + k));
+        }
+    }
+    memmove(&filhoInterna(destino, tamPagina, para + n - 1), &filhoInterna(origem, tamPagina, de + n - 1), n*sizeof(int));
+}
+
+/**
+ * @brief Regrava uma página interna com os pares dados, no formato que couber
+ * @param no Página interna (recebe tipo, quant e formato)
+ * @param tamPagina Tamanho da página em bytes
+ * @param e Pares; do primeiro só o filho é usado
+ * @param n Quantidade de pares (até capacidadeInterna + 1)
+ * @param baixo Menor chave que pode estar abaixo da página
+ * @param alto Maior chave que pode estar abaixo da página
+ *
+ * A página fica compacta, com a base em baixo, quando os limites cabem no
+ * alcance das distâncias (cabeCompacta).
+ */
+void montarInterna(pagina &no, int tamPagina, const entrada *e, int n, tipoChave baixo, tipoChave alto) {
+    no.interna.tipo = PAGINA_INTERNA;
+    no.interna.quant = n - 1;
+    no.interna.compacta = cabeCompacta(baixo, alto) && n - 1 <= capacidadeCompacta(tamPagina);
+    no.interna.prev = -1;
+    no.interna.chave[0] = baixo;
+    escreverEntradas(no, tamPagina, 0, e, n);
+}
+
+/**
+ * @brief Troca os limites de uma página interna, mudando o formato se preciso
+ * @param no Página interna
+ * @param tamPagina Tamanho da página em bytes
+ * @param baixo Novo limite inferior
+ * @param alto Novo limite superior
+ *
+ * Usada quando a página está para receber separadores de fora dos limites
+ * antigos (fusão ou empréstimo de uma irmã).
+ */
+void relimitarInterna(pagina &no, int tamPagina, tipoChave baixo, tipoChave alto) {
+    vector<entrada> itens;
+    for (int k = 0; k <= no.interna.quant; k++) itens.push_back(entradaInterna(no, tamPagina, k));
+    montarInterna(no, tamPagina, itens.data(), itens.size(), baixo, alto);
+}
+
+/**
+ * @brief Prepara o buffer pool de um arquivo já aberto
+ * @param arq Arquivo com o cabeçalho já carregado em arq.cab
+ * @param capacidade Quantidade de quadros (no mínimo QUADROS_MIN)
+ */
+void iniciarCache(arquivo &arq, int capacidade) {
+    if (capacidade < QUADROS_MIN) capacidade = QUADROS_MIN;
+    quadro vazio = {-1, 0, false, false, false, false, 0, 0, false};
+    arq.quadros.assign(capacidade, vazio);
+    arq.memoria.assign(capacidade, pagina());
+    arq.tabela.clear();
+    arq.relogio = 0;
+    arq.travas.reset(new shared_mutex[capacidade]);
+    arq.versao.reset(new atomic<unsigned long long>[capacidade]);
+    arq.paginaQuadro.reset(new atomic<int>[capacidade]);
+    for (int i = 0; i < capacidade; i++) {
+        arq.versao[i].store(0);
+        arq.paginaQuadro[i].store(-1);
+    }
+    int tamDica = 1;
+    while (tamDica < 2*capacidade) tamDica *= 2;
+    arq.dica.reset(new atomic<int>[tamDica]);
+    for (int k = 0; k < tamDica; k++) arq.dica[k].store(-1);
+    arq.mascaraDica = tamDica - 1;
+    arq.raizAltura.store(((long long)arq.cab.cabecalho.raiz << 32) | arq.cab.cabecalho.altura);
+    arq.mudancas.store(0);
+    arq.cabSujo = false;
+    arq.mapa = NULL;
+    arq.fd = -1;
+    arq.fdDados = -1;
+    arq.blocoDisco = 0;
+    arq.fdLog = -1;
+    arq.tamLog = 0;
+    arq.alteradas.clear();
+    arq.bufLog.clear();
+    arq.lsnAnexado = arq.lsnDuravel = 0;
+    arq.gravandoLog = false;
+    arq.mapaLivres = false;
+    arq.livresOrdem.clear();
+    arq.anteriorLivre.clear();
+    arq.folhasOrdenadas = 0;
+    arq.alocacao = ALOCACAO_PILHA;
+    arq.epoca = 0;
+    arq.instantaneos.clear();
+    arq.quantInstantaneos.store(0);
+    arq.versoes.clear();
+    arq.filtro.atual.store(NULL);
+    arq.filtro.tabelas.clear();
+    arq.filtro.capacidade = arq.filtro.chaves = 0;
+    arq.nomeFiltro.clear();
+    arq.bytesLidos.store(0);
+    arq.bytesGravados.store(0);
+    zerarEstatisticas(arq);
+}
+
+/**
+ * @brief Mapeia o arquivo inteiro em memória no lugar do buffer pool
+ * @param arq Arquivo com o cabeçalho já carregado em arq.cab
+ * @param nome Caminho do arquivo de dados
+ * @return true se o mapeamento foi criado
+ *
+ * Como o arquivo tem tamanho fixo (cab.cabecalho.tam páginas, criadas por
+ * inicializar), o mapeamento cobre todas as páginas e fixar passa a ser
+ * apenas o cálculo de um endereço. As alterações chegam ao disco pelo
+ * msync feito em descarregar.
+ */
+bool mapearArquivo(arquivo &arq, const char *nome) {
+    arq.fd = open(nome, O_RDWR);
+    if (arq.fd == -1) return false;
+    arq.tamMapa = (size_t)(arq.cab.cabecalho.tam + 1)*arq.cab.cabecalho.tamPagina;
+    void *m = mmap(NULL, arq.tamMapa, PROT_READ | PROT_WRITE, MAP_SHARED, arq.fd, 0);
+    if (m == MAP_FAILED) {
+        close(arq.fd);
+        arq.fd = -1;
+        return false;
+    }
+    arq.mapa = (char*)m;
+    arq.sujoIni = arq.cab.cabecalho.tam + 1;
+    arq.sujoFim = -1;
+    return true;
+}
+
+/**
+ * @brief Acrescenta uma página ao intervalo que o próximo msync deve gravar
+ * @param arq Arquivo mapeado
+ * @param pos Número da página alterada
+ */
+void marcarMapa(arquivo &arq, int pos) {
+    if (pos < arq.sujoIni) arq.sujoIni = pos;
+    if (pos > arq.sujoFim) arq.sujoFim = pos;
+}
+
+/**
+ * @brief Escolhe um quadro para receber uma nova página (algoritmo CLOCK)
+ * @param arq Arquivo aberto
+ * @return Índice do quadro escolhido, ou -1 se todos estiverem fixados
+ *
+ * O ponteiro percorre os quadros em círculo: quadros fixados são pulados,
+ * quadros com o bit de referência ligado ganham uma segunda chance e o
+ * primeiro quadro sem referência é o escolhido. Quadros alterados pela
+ * operação ainda não confirmada, ou cujo bloco ainda não chegou ao disco,
+ * também são pulados: a página só pode chegar ao arquivo depois que o
+ * seu registro estiver no log.
+ */
+int escolherVitima(arquivo &arq) {
+    long long duravel;
+    {
+        lock_guard<mutex> trava(arq.mLog);
+        duravel = arq.lsnDuravel;
+    }
+    int n = arq.quadros.size();
+    for (int passo = 0; passo < 2*n; passo++) {
+        int i = arq.relogio;
+        arq.relogio = (arq.relogio + 1) % n;
+        quadro &q = arq.quadros[i];
+        if (q.pinos > 0 || q.pendente || q.lsn > duravel) continue;
+        if (q.ref) {
+            q.ref = false;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Registra que o quadro foi alterado pela operação em andamento
+ * @param arq Arquivo aberto
+ * @param i Índice do quadro
+ *
+ * Uma folha fria alterada volta a ser quente (gravada sem compressão).
+ */
+void marcarPendente(arquivo &arq, int i) {
+    quadro &q = arq.quadros[i];
+    q.sujo = true;
+    q.fria = false;
+    if (arq.fdLog != -1 && !q.pendente) {
+        q.pendente = true;
+        arq.alteradas.push_back(q.pos);
+    }
+}
+
+/**
+ * @brief Grava bytes em uma posição do arquivo de dados
+ * @param arq Arquivo aberto
+ * @param p Bytes a gravar
+ * @param n Quantidade de bytes
+ * @param pos Deslocamento no arquivo
+ */
+void gravarDados(arquivo &arq, const void *p, size_t n, off_t pos) {
+    MEDIR_ES();
+    CONTAR(CONT_GRAVACOES, 1);
+    CONTAR(CONT_BYTES_GRAVADOS, n);
+    if (pwrite(arq.fdDados, p, n, pos) != (ssize_t)n) {
+        cerr << "Erro: falha ao gravar pagina.dat!\n";
+        exit(1);
+    }
+    arq.bytesGravados += n;
+}
+
+/**
+ * @brief Lê bytes de uma posição do arquivo de dados
+ * @param arq Arquivo aberto
+ * @param p Destino
+ * @param n Quantidade de bytes
+ * @param pos Deslocamento no arquivo
+ *
+ * Bytes além do fim do arquivo são lidos como zero.
+ */
+void lerDados(arquivo &arq, void *p, size_t n, off_t pos) {
+    MEDIR_ES();
+    ssize_t lidos = pread(arq.fdDados, p, n, pos);
+    if (lidos < 0) lidos = 0;
+    CONTAR(CONT_LEITURAS, 1);
+    CONTAR(CONT_BYTES_LIDOS, lidos);
+    if ((size_t)lidos < n) memset((char*)p + lidos, 0, n - lidos);
+    arq.bytesLidos += lidos;
+}
+
+/**
+ * @brief Lê vários trechos do arquivo de dados de uma vez
+ * @param arq Arquivo aberto
+ * @param pedidos Trechos a ler (destino, tamanho e posição de cada um)
+ *
+ * As leituras ficam em voo ao mesmo tempo (leitorAssincrono), de modo que
+ * a latência do disco é paga uma vez por lote e não uma vez por página.
+ * Como em lerDados, bytes além do fim do arquivo são lidos como zero.
+ */
+void lerDadosLote(arquivo &arq, vector<pedidoLeitura> &pedidos) {
+    if (pedidos.size() == 1 || arq.leitor.fd == -1) {
+        for (size_t k = 0; k < pedidos.size(); k++) lerDados(arq, pedidos[k].destino, pedidos[k].tam, pedidos[k].pos);
+        return;
+    }
+    MEDIR_ES();
+    lerLote(arq.leitor, pedidos.data(), pedidos.size());
+    for (size_t k = 0; k < pedidos.size(); k++) {
+        pedidoLeitura &p = pedidos[k];
+        if (p.lidos < 0) p.lidos = 0;
+        if ((size_t)p.lidos < p.tam) memset((char*)p.destino + p.lidos, 0, p.tam - p.lidos);
+        arq.bytesLidos += p.lidos;
+        CONTAR(CONT_LEITURAS, 1);
+        CONTAR(CONT_BYTES_LIDOS, p.lidos);
+    }
+}
+
+#define CAB_COMPRIMIDA (4*(int)sizeof(int))  ///< Bytes do cabeçalho da página comprimida, antes dos dados
+#define REPETICAO_MIN 4                      ///< Menor repetição codificada pelo compressor (bytes)
+#define BITS_HASH_LZ 12                      ///< Bits do índice da tabela de posições do compressor
+
+/**
+ * @brief Copia para buf as partes usadas de uma folha, sem o espaço livre
+ * @param l Página folha
+ * @param tamPagina Tamanho da página em bytes
+ * @param buf Destino (até tamPagina bytes)
+ * @return Bytes gravados em buf
+ *
+ * Vão o cabeçalho da folha, as chaves como diferenças até a anterior
+ * (chaves próximas viram os mesmos bytes repetidos, que o compressor
+ * aproveita), os slots e a área de valores, de topo até o fim. O espaço
+ * livre entre os slots e topo fica de fora.
+ */
+int serializarFolha(pagina &l, int tamPagina, unsigned char *buf) {
+    int quant = l.folha.quant;
+    int n = CAB_FOLHA;
+    memcpy(buf, l.bytes, CAB_FOLHA);
+    unsigned long long anterior = 0;
+    for (int k = 0; k < quant; k++) {
+        tipoChave diferenca = (tipoChave)((unsigned long long)l.folha.chave[k] - anterior);
+        memcpy(buf + n, &diferenca, sizeof(tipoChave));
+        n += sizeof(tipoChave);
+        anterior = (unsigned long long)l.folha.chave[k];
+    }
+    memcpy(buf + n, slotsFolha(l, quant), quant*sizeof(slot));
+    n += quant*sizeof(slot);
+    memcpy(buf + n, l.bytes + l.folha.topo, tamPagina - l.folha.topo);
+    return n + tamPagina - l.folha.topo;
+}
+
+/**
+ * @brief Remonta uma folha a partir do resultado de serializarFolha
+ * @param buf Folha serializada
+ * @param n Bytes em buf
+ * @param tamPagina Tamanho da página em bytes
+ * @param l Destino
+ * @return false se buf não tem o formato esperado
+ */
+bool desserializarFolha(const unsigned char *buf, int n, int tamPagina, pagina &l) {
+    if (n < CAB_FOLHA) return false;
+    memset(&l, 0, tamPagina);
+    memcpy(l.bytes, buf, CAB_FOLHA);
+    int quant = l.folha.quant, topo = l.folha.topo;
+    if (l.folha.tipo != PAGINA_FOLHA || quant < 0 || quant > capacidadeFolha(tamPagina) ||
+        topo < CAB_FOLHA + quant*(int)(sizeof(tipoChave) + sizeof(slot)) || topo > tamPagina ||
+        n != CAB_FOLHA + quant*(int)(sizeof(tipoChave) + sizeof(slot)) + tamPagina - topo) return false;
+    int p = CAB_FOLHA;
+    unsigned long long anterior = 0;
+    for (int k = 0; k < quant; k++) {
+        tipoChave diferenca;
+        memcpy(&diferenca, buf + p, sizeof(tipoChave));
+        p += sizeof(tipoChave);
+        anterior += (unsigned long long)diferenca;
+        l.folha.chave[k] = (tipoChave)anterior;
+    }
+    memcpy(slotsFolha(l, quant), buf + p, quant*sizeof(slot));
+    p += quant*sizeof(slot);
+    memcpy(l.bytes + topo, buf + p, tamPagina - topo);
+    return true;
+}
+
+/**
+ * @brief Grava uma sequência do formato de comprimirLz
+ * @param dest Destino
+ * @param d Posição em dest, avançada
+ * @param max Bytes disponíveis em dest
+ * @param literais Bytes copiados sem compressão
+ * @param quantLiterais Quantidade de literais
+ * @param distancia Distância até o início da repetição
+ * @param tam Bytes da repetição (0 na última sequência)
+ * @return false se a sequência não cabe em max
+ */
+bool gravarSequencia(unsigned char *dest, int &d, int max, const unsigned char *literais, int quantLiterais, int distancia, int tam) {
+    if (d + 1 + quantLiterais + quantLiterais/255 + 1 + 2 + tam/255 + 1 > max) return false;
+    int extra = tam ? tam - REPETICAO_MIN : 0;
+    dest[d++] = std::min(quantLiterais, 15) << 4 | std::min(extra, 15);
+    if (quantLiterais >= 15) {
+        int resto = quantLiterais - 15;
+        for (; resto >= 255; resto -= 255) dest[d++] = 255;
+        dest[d++] = resto;
+    }
+    memcpy(dest + d, literais, quantLiterais);
+    d += quantLiterais;
+    if (tam == 0) return true;
+    dest[d++] = distancia & 0xff;
+    dest[d++] = distancia >> 8;
+    if (extra >= 15) {
+        int resto = extra - 15;
+        for (; resto >= 255; resto -= 255) dest[d++] = 255;
+        dest[d++] = resto;
+    }
+    return true;
+}
+
+/**
+ * @brief Comprime bytes com um LZ77 simples, com as sequências do formato de blocos do LZ4
+ * @param orig Bytes a comprimir (no máximo TAM_PAGINA_MAX)
+ * @param n Quantidade de bytes
+ * @param dest Destino
+ * @param max Bytes disponíveis em dest
+ * @return Bytes comprimidos, ou 0 se o resultado não cabe em max
+ *
+ * Cada sequência é um byte de controle (nos 4 bits altos, a quantidade
+ * de literais; nos baixos, o tamanho da repetição menos REPETICAO_MIN; 15
+ * continua nos bytes seguintes, somados até um diferente de 255), os
+ * literais, a distância da repetição em 2 bytes e o resto do tamanho. A
+ * última sequência só tem literais. As repetições são achadas por uma
+ * tabela com a última posição de cada grupo de 4 bytes, sem voltar atrás.
+ *
+ * Complexidade: O(n)
+ */
+int comprimirLz(const unsigned char *orig, int n, unsigned char *dest, int max) {
+    unsigned short ultima[1 << BITS_HASH_LZ];  // Posição mais um (0 = vazia)
+    memset(ultima, 0, sizeof(ultima));
+    int i = 0, literais = 0, d = 0;
+    while (i + REPETICAO_MIN <= n) {
+        unsigned v;
+        memcpy(&v, orig + i, sizeof(v));
+        unsigned h = v*2654435761u >> (32 - BITS_HASH_LZ);
+        int candidato = ultima[h] - 1;
+        ultima[h] = i + 1;
+        if (candidato < 0 || memcmp(orig + candidato, orig + i, REPETICAO_MIN) != 0) {
+            i++;
+            continue;
+        }
+        int tam = REPETICAO_MIN;
+        while (i + tam < n && orig[candidato + tam] == orig[i + tam]) tam++;
+        if (!gravarSequencia(dest, d, max, orig + literais, i - literais, i - candidato, tam)) return 0;
+        i += tam;
+        literais = i;
+    }
+    if (!gravarSequencia(dest, d, max, orig + literais, n - literais, 0, 0)) return 0;
+    return d;
+}
+
+/**
+ * @brief Lê a continuação de um comprimento do formato de comprimirLz
+ * @param orig Bytes comprimidos
+ * @param n Quantidade de bytes comprimidos
+ * @param s Posição em orig, avançada
+ * @param valor Comprimento, acrescido dos bytes lidos
+ * @return false se os bytes acabam no meio do comprimento
+ */
+bool lerComprimento(const unsigned char *orig, int n, int &s, int &valor) {
+    int b;
+    do {
+        if (s >= n) return false;
+        b = orig[s++];
+        valor += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * @brief Desfaz comprimirLz
+ * @param orig Bytes comprimidos
+ * @param n Quantidade de bytes comprimidos
+ * @param dest Destino
+ * @param max Bytes disponíveis em dest
+ * @return Bytes recuperados, ou -1 se orig não está no formato ou não cabe em max
+ */
+int expandirLz(const unsigned char *orig, int n, unsigned char *dest, int max) {
+    int s = 0, d = 0;
+    while (s < n) {
+        int controle = orig[s++];
+        int literais = controle >> 4;
+        if (literais == 15 && !lerComprimento(orig, n, s, literais)) return -1;
+        if (literais > n - s || literais > max - d) return -1;
+        memcpy(dest + d, orig + s, literais);
+        s += literais;
+        d += literais;
+        if (s == n) break;
+
+        if (n - s < 2) return -1;
+        int distancia = orig[s] | orig[s + 1] << 8;
+        s += 2;
+        int tam = controle & 15;
+        if (tam == 15 && !lerComprimento(orig, n, s, tam)) return -1;
+        tam += REPETICAO_MIN;
+        if (distancia == 0 || distancia > d || tam > max - d) return -1;
+        for (int k = 0; k < tam; k++, d++) dest[d] = dest[d - distancia];
+    }
+    return d;
+}
+
+/**
+ * @brief Monta a forma comprimida de uma folha fria
+ * @param arq Arquivo aberto
+ * @param l Folha
+ * @param saida Recebe a página comprimida
+ * @return Bytes de saida a gravar, ou 0 se a compressão não libera nenhum
+ *         bloco do sistema de arquivos (a folha é gravada inteira)
+ */
+int comprimirFolha(arquivo &arq, pagina &l, pagina &saida) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    int max = tamPagina - arq.blocoDisco - CAB_COMPRIMIDA;
+    if (arq.blocoDisco == 0 || max <= 0 || l.folha.tipo != PAGINA_FOLHA) return 0;
+    unsigned char serial[TAM_PAGINA_MAX];
+    int n = serializarFolha(l, tamPagina, serial);
+    int tam = comprimirLz(serial, n, saida.comprimida.dados, max);
+    if (tam == 0) return 0;
+    saida.comprimida.tipo = PAGINA_COMPRIMIDA;
+    saida.comprimida.tam = tam;
+    saida.comprimida.original = n;
+    saida.comprimida.prev = 0;
+    return CAB_COMPRIMIDA + tam;
+}
+
+/**
+ * @brief Devolve à forma de folha uma página recém-lida, se estiver comprimida
+ * @param p Página lida do arquivo
+ * @param tamPagina Tamanho da página em bytes
+ * @return true se a página estava comprimida (folha fria)
+ */
+bool expandirFolha(pagina &p, int tamPagina) {
+    if (p.comprimida.tipo != PAGINA_COMPRIMIDA) return false;
+    unsigned char serial[TAM_PAGINA_MAX];
+    int tam = p.comprimida.tam, original = p.comprimida.original;
+    if (tam < 0 || tam > tamPagina - CAB_COMPRIMIDA ||
+        expandirLz(p.comprimida.dados, tam, serial, tamPagina) != original ||
+        !desserializarFolha(serial, original, tamPagina, p)) {
+        cerr << "Erro: folha comprimida corrompida em pagina.dat!\n";
+        exit(1);
+    }
+    return true;
+}
+
+/**
+ * @brief Grava no arquivo a página de um quadro
+ * @param arq Arquivo aberto (com mCache travado)
+ * @param i Índice do quadro
+ *
+ * Uma folha fria vai comprimida quando isso libera pelo menos um bloco
+ * do sistema de arquivos: o resto da página vira um buraco
+ * (FALLOC_FL_PUNCH_HOLE), que não ocupa disco e é lido como zeros sem
+ * acessar o dispositivo. Se o sistema de arquivos não aceita buracos, as
+ * folhas frias passam a ser gravadas inteiras.
+ */
+void gravarQuadro(arquivo &arq, int i) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    off_t pos = (off_t)arq.quadros[i].pos*tamPagina;
+    if (arq.quadros[i].fria) {
+        pagina c;
+        int n = comprimirFolha(arq, arq.memoria[i], c);
+        if (n > 0) {
+            gravarDados(arq, &c, n, pos);
+            int usados = (n + arq.blocoDisco - 1) / arq.blocoDisco * arq.blocoDisco;
+            if (fallocate(arq.fdDados, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos + usados, tamPagina - usados) != 0) {
+                arq.blocoDisco = 0;
+            }
+            return;
+        }
+    }
+    gravarDados(arq, &arq.memoria[i], tamPagina, pos);
+}
+
+void esperarLog(arquivo &arq, long long lsn);
+
+/**
+ * @brief Reserva um quadro para receber uma página
+ * @param arq Arquivo aberto
+ * @param trava Trava de mCache, com a thread; é solta durante a espera e a E/S
+ * @param pos Página que vai ocupar o quadro (fora da tabela)
+ * @return Índice do quadro, ou -1 se pos entrou na tabela enquanto a trava
+ *         estava solta
+ *
+ * O quadro sai daqui já associado a pos na tabela, fixado e marcado como
+ * carregando: quem pedir pos espera em cvCarga em vez de ler a página de
+ * novo. A página que ocupava o quadro, se suja, é gravada antes com
+ * mCache solta; enquanto isso ela continua na tabela, e quem a pedir
+ * espera e depois a procura de novo (já gravada, ela vem do disco). O
+ * quadro fica com versão ímpar até terminarCarga.
+ */
+int reservarQuadro(arquivo &arq, unique_lock<mutex> &trava, int pos) {
+    int i = escolherVitima(arq);
+    if (i == -1 && arq.fdLog != -1) {
+        // Pode haver quadros esperando só o fdatasync do grupo em andamento
+        long long ultimo;
+        {
+            lock_guard<mutex> travaLog(arq.mLog);
+            ultimo = arq.lsnAnexado;
+        }
+        trava.unlock();
+        esperarLog(arq, ultimo);
+        trava.lock();
+        if (arq.tabela.count(pos)) return -1;
+        i = escolherVitima(arq);
+    }
+    if (i == -1) {
+        cerr << "Erro: todos os quadros do cache estao fixados!\n";
+        exit(1);
+    }
+
+    // Leitores otimistas que estejam no quadro vão perceber a troca
+    arq.versao[i].fetch_add(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    arq.paginaQuadro[i].store(-1, memory_order_relaxed);
+
+    quadro &q = arq.quadros[i];
+    int antiga = q.pos;
+    q.pinos = 1;
+    q.carregando = true;
+    arq.tabela[pos] = i;
+
+    // Devolve ao disco a página que ocupava o quadro
+    if (antiga != -1 && q.sujo) {
+        trava.unlock();
+        gravarQuadro(arq, i);
+        trava.lock();
+    }
+    if (antiga != -1) arq.tabela.erase(antiga);
+    q.pos = pos;
+    q.sujo = false;
+    q.ref = true;
+    q.pendente = false;
+    q.fria = false;
+    q.lsn = 0;
+    q.epoca = 0;
+    return i;
+}
+
+/**
+ * @brief Encerra o carregamento de um quadro reservado por reservarQuadro
+ * @param arq Arquivo aberto (com mCache travado)
+ * @param i Índice do quadro, já preenchido
+ * @param pos Número da página carregada
+ *
+ * Associa o quadro à página para os leitores otimistas e acorda quem
+ * esperava por ele.
+ */
+void terminarCarga(arquivo &arq, int i, int pos) {
+    arq.paginaQuadro[i].store(pos, memory_order_relaxed);
+    arq.dica[pos & arq.mascaraDica].store(i, memory_order_relaxed);
+    arq.versao[i].fetch_add(1, memory_order_release);
+    arq.quadros[i].carregando = false;
+    arq.cvCarga.notify_all();
+}
+
+/**
+ * @brief Adquire a trava de um quadro recém-fixado pela thread atual
+ * @param arq Arquivo aberto
+ * @param i Índice do quadro
+ *
+ * A thread de escrita trava de forma exclusiva; as demais, compartilhada.
+ * Se a thread já tem a trava do quadro, só conta mais um uso. A trava
+ * exclusiva deixa a versão do quadro ímpar até ser liberada.
+ */
+void travarQuadro(arquivo &arq, int i) {
+    vector<travaThread> &travas = minhaThread.travas;
+    for (size_t k = 0; k < travas.size(); k++) {
+        if (travas[k].quadro == i) {
+            travas[k].usos++;
+            return;
+        }
+    }
+    travaThread t = {i, 1, minhaThread.escrita};
+    if (t.exclusiva) {
+        arq.travas[i].lock();
+        arq.versao[i].fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    } else {
+        arq.travas[i].lock_shared();
+    }
+    travas.push_back(t);
+}
+
+/**
+ * @brief Libera um uso da trava de um quadro pela thread atual
+ * @param arq Arquivo aberto
+ * @param i Índice do quadro
+ */
+void destravarQuadro(arquivo &arq, int i) {
+    vector<travaThread> &travas = minhaThread.travas;
+    for (size_t k = 0; k < travas.size(); k++) {
+        if (travas[k].quadro != i) continue;
+        if (--travas[k].usos == 0) {
+            if (travas[k].exclusiva) {
+                arq.versao[i].fetch_add(1, memory_order_release);
+                arq.travas[i].unlock();
+            } else {
+                arq.travas[i].unlock_shared();
+            }
+            travas[k] = travas.back();
+            travas.pop_back();
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Guarda a imagem de uma página antes de o escritor alterá-la
+ * @param arq Arquivo aberto (buffer pool)
+ * @param i Índice do quadro, já travado para escrita pela thread atual
+ * @param nova A página acabou de ser alocada (o conteúdo do quadro não é dela)
+ *
+ * Só a primeira trava de cada escrita copia a página, e só enquanto há
+ * instantâneos abertos: todos eles são de antes da escrita em andamento,
+ * então a imagem vale para os que ainda não a tinham. Uma página recém-
+ * alocada não precisa de imagem: se algum instantâneo a alcança, ela foi
+ * liberada depois dele, e a imagem guardada ao liberar é a que vale.
+ */
+void guardarVersao(arquivo &arq, int i, bool nova) {
+    quadro &q = arq.quadros[i];
+    long long atual = arq.epoca + 1;
+    if (q.epoca == atual) return;
+    q.epoca = atual;
+    if (nova || arq.quantInstantaneos.load(memory_order_relaxed) == 0) return;
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    lock_guard<mutex> trava(arq.mVersoes);
+    if (arq.instantaneos.empty()) return;
+    const char *p = (const char*)&arq.memoria[i];
+    arq.versoes[q.pos].push_back({atual, vector<char>(p, p + tamPagina)});
+    CONTAR(CONT_VERSOES, 1);
+}
+
+/**
+ * @brief Fixa uma página no buffer pool
+ * @param arq Arquivo aberto
+ * @param pos Número da página
+ * @param nova Se true, a página acabou de ser alocada e não é lida do disco
+ * @return Ponteiro para a página em memória, válido até desafixar
+ *
+ * Se a página não estiver em memória, um quadro é reservado pelo CLOCK
+ * (reservarQuadro) e a página é lida com mCache solta: a gravação da
+ * página que ocupava o quadro e a leitura da nova não impedem as outras
+ * threads de usar o cache. Quem pede uma página que está sendo carregada
+ * espera o carregamento terminar. O quadro é fixado sob mCache e a trava
+ * de conteúdo é adquirida depois, fora dela: quem espera uma trava também
+ * não impede as outras threads de usar o cache.
+ */
+pagina *fixar(arquivo &arq, int pos, bool nova = false) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+
+    // Arquivo mapeado: a página já está no endereço correspondente
+    if (arq.mapa) {
+        pagina *p = (pagina*)(arq.mapa + (size_t)pos*tamPagina);
+        if (nova) {
+            memset(p, 0, tamPagina);
+            marcarMapa(arq, pos);
+        }
+        return p;
+    }
+
+    int i;
+    {
+        unique_lock<mutex> trava(arq.mCache);
+        while (true) {
+            unordered_map<int, int>::iterator it = arq.tabela.find(pos);
+            if (it != arq.tabela.end()) {
+                i = it->second;
+                quadro &q = arq.quadros[i];
+                q.pinos++;
+                q.ref = true;
+                if (q.carregando) {
+                    // Fixado, o quadro não muda de página antes de a espera acabar
+                    arq.cvCarga.wait(trava, [&q]() { return !q.carregando; });
+                    if (q.pos != pos) {
+                        // Era a página antiga do quadro, gravada no meio da espera
+                        q.pinos--;
+                        continue;
+                    }
+                }
+                arq.dica[pos & arq.mascaraDica].store(i, memory_order_relaxed);
+                CONTAR(CONT_ACERTOS, 1);
+                break;
+            }
+
+            i = reservarQuadro(arq, trava, pos);
+            if (i == -1) continue;
+            bool fria = false;
+            if (!nova) {
+                trava.unlock();
+                lerDados(arq, &arq.memoria[i], tamPagina, (off_t)pos*tamPagina);
+                fria = expandirFolha(arq.memoria[i], tamPagina);
+                CONTAR(CONT_FALTAS, 1);
+                trava.lock();
+            }
+            arq.quadros[i].fria = fria;
+            terminarCarga(arq, i, pos);
+            break;
+        }
+    }
+
+    travarQuadro(arq, i);
+    if (minhaThread.escrita) guardarVersao(arq, i, nova);
+    if (nova) {
+        memset(&arq.memoria[i], 0, tamPagina);
+        lock_guard<mutex> trava(arq.mCache);
+        marcarPendente(arq, i);
+    }
+    return &arq.memoria[i];
+}
+
+/**
+ * @brief Carrega antecipadamente um conjunto de páginas do arquivo
+ * @param arq Arquivo aberto
+ * @param pos Números das páginas
+ * @param quant Quantidade de páginas
+ *
+ * As páginas que ainda não estão no cache são lidas em um único lote
+ * (lerDadosLote), com uma leitura por sequência de páginas consecutivas,
+ * e colocadas em quadros não fixados, prontos para o próximo fixar. Os
+ * quadros são reservados com mCache e a leitura é feita fora dela; quem
+ * fixar uma dessas páginas antes espera o carregamento terminar. No
+ * arquivo mapeado, apenas avisa o sistema operacional (MADV_WILLNEED).
+ */
+void anteciparLista(arquivo &arq, const int *pos, int quant) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    if (arq.mapa) {
+        for (int k = 0; k < quant; k++) {
+            if (pos[k] > 0 && pos[k] <= arq.cab.cabecalho.tam) {
+                madvise(arq.mapa + (size_t)pos[k]*tamPagina, tamPagina, MADV_WILLNEED);
+            }
+        }
+        return;
+    }
+
+    // Não ocupa mais que metade do cache com páginas antecipadas
+    int limite = arq.quadros.size() / 2;
+
+    // Os quadros ficam reservados (reservarQuadro) até a leitura terminar,
+    // que é feita com mCache solta. Páginas já no cache ficam como estão:
+    // a cópia delas pode estar mais nova que a do disco
+    unique_lock<mutex> trava(arq.mCache);
+    vector<int> paginas, quadrosLidos;
+    for (int k = 0; k < quant && (int)paginas.size() < limite; k++) {
+        int p = pos[k];
+        if (p <= 0 || p > arq.cab.cabecalho.tam || arq.tabela.count(p)) continue;
+        int i = reservarQuadro(arq, trava, p);  // Fixado até a leitura terminar
+        if (i == -1) continue;
+        paginas.push_back(p);
+        quadrosLidos.push_back(i);
+    }
+    if (paginas.empty()) return;
+    trava.unlock();
+
+    // Uma leitura para cada sequência de páginas consecutivas
+    vector<int> ordem(paginas.size());
+    for (size_t k = 0; k < ordem.size(); k++) ordem[k] = k;
+    sort(ordem.begin(), ordem.end(), [&paginas](int a, int b) { return paginas[a] < paginas[b]; });
+    vector<char> buf(paginas.size()*(size_t)tamPagina);
+    vector<pedidoLeitura> pedidos;
+    for (size_t k = 0; k < ordem.size(); k++) {
+        int p = paginas[ordem[k]];
+        char *destino = &buf[k*(size_t)tamPagina];
+        if (k > 0 && p == paginas[ordem[k - 1]] + 1) pedidos.back().tam += tamPagina;
+        else pedidos.push_back({destino, (size_t)tamPagina, (off_t)p*tamPagina, 0});
+    }
+    lerDadosLote(arq, pedidos);
+
+    // Os quadros reservados só são usados por esta thread até terminarCarga
+    vector<bool> frias(ordem.size());
+    for (size_t k = 0; k < ordem.size(); k++) {
+        int i = quadrosLidos[ordem[k]];
+        memcpy(&arq.memoria[i], &buf[k*(size_t)tamPagina], tamPagina);
+        frias[k] = expandirFolha(arq.memoria[i], tamPagina);
+    }
+
+    trava.lock();
+    for (size_t k = 0; k < ordem.size(); k++) {
+        int i = quadrosLidos[ordem[k]], p = paginas[ordem[k]];
+        quadro &q = arq.quadros[i];
+        q.fria = frias[k];
+        q.pinos--;  // Quem esperou o carregamento continua com a sua fixação
+        terminarCarga(arq, i, p);
+    }
+}
+
+/**
+ * @brief Carrega antecipadamente páginas consecutivas do arquivo
+ * @param arq Arquivo aberto
+ * @param pos Primeira página
+ * @param quant Quantidade de páginas
+ *
+ * As que faltam no cache costumam formar uma única sequência e são lidas
+ * com uma só leitura (anteciparLista).
+ */
+void anteciparPaginas(arquivo &arq, int pos, int quant) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    if (pos + quant > arq.cab.cabecalho.tam + 1) quant = arq.cab.cabecalho.tam + 1 - pos;
+    if (quant <= 0) return;
+
+    if (arq.mapa) {
+        madvise(arq.mapa + (size_t)pos*tamPagina, (size_t)quant*tamPagina, MADV_WILLNEED);
+        return;
+    }
+    vector<int> paginas(quant);
+    for (int k = 0; k < quant; k++) paginas[k] = pos + k;
+    anteciparLista(arq, paginas.data(), quant);
+}
+
+/**
+ * @brief Libera uma fixação feita por fixar
+ * @param arq Arquivo aberto
+ * @param pos Número da página
+ * @param sujo Se true, a página foi alterada e deverá ser gravada
+ */
+void desafixar(arquivo &arq, int pos, bool sujo) {
+    if (arq.mapa) {
+        if (sujo) marcarMapa(arq, pos);
+        return;
+    }
+    int i;
+    {
+        lock_guard<mutex> trava(arq.mCache);
+        i = arq.tabela[pos];
+        arq.quadros[i].pinos--;
+        if (sujo) marcarPendente(arq, i);
+    }
+    destravarQuadro(arq, i);
+}
+
+/**
+ * @brief Marca como alterada uma página que já está fixada
+ * @param arq Arquivo aberto
+ * @param pos Número da página
+ */
+void marcarSuja(arquivo &arq, int pos) {
+    if (arq.mapa) {
+        marcarMapa(arq, pos);
+        return;
+    }
+    lock_guard<mutex> trava(arq.mCache);
+    marcarPendente(arq, arq.tabela[pos]);
+}
+
+#define TENTATIVAS_OTIMISTAS 8  ///< Leituras otimistas antes de recorrer às travas
+
+/**
+ * @brief Começa a leitura otimista de uma página que está no cache
+ * @param arq Arquivo aberto (buffer pool)
+ * @param pos Número da página
+ * @param versao Recebe a versão do quadro no início da leitura
+ * @return Índice do quadro, ou -1 se a página não está no cache ou está
+ *         sendo alterada
+ *
+ * Não fixa nem trava nada. O conteúdo do quadro só vale se validarLeitura
+ * confirmar depois que a versão não mudou.
+ */
+int iniciarLeitura(arquivo &arq, int pos, unsigned long long &versao) {
+    int i = arq.dica[pos & arq.mascaraDica].load(memory_order_relaxed);
+    if (i == -1) return -1;
+    versao = arq.versao[i].load(memory_order_acquire);
+    if ((versao & 1) || arq.paginaQuadro[i].load(memory_order_relaxed) != pos) return -1;
+    CONTAR(CONT_ACERTOS, 1);
+    return i;
+}
+
+/**
+ * @brief Confere se o quadro não mudou desde iniciarLeitura
+ * @param arq Arquivo aberto
+ * @param i Índice do quadro
+ * @param versao Versão anotada por iniciarLeitura
+ */
+bool validarLeitura(arquivo &arq, int i, unsigned long long versao) {
+    atomic_thread_fence(memory_order_acquire);
+    return arq.versao[i].load(memory_order_relaxed) == versao;
+}
+
+/**
+ * @brief Grava no arquivo todas as páginas sujas e o cabeçalho
+ * @param arq Arquivo aberto
+ *
+ * As páginas continuam no cache, agora limpas. No arquivo mapeado é o
+ * ponto de confirmação: o msync só retorna depois que o intervalo de
+ * páginas alteradas estiver no disco, e uma falha encerra o programa.
+ */
+void descarregar(arquivo &arq) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+
+    // Arquivo mapeado: copia o cabeçalho e sincroniza só as páginas alteradas
+    if (arq.mapa) {
+        if (arq.cabSujo) {
+            memcpy(arq.mapa, &arq.cab, sizeof(arq.cab.cabecalho));
+            marcarMapa(arq, 0);
+            arq.cabSujo = false;
+        }
+        if (arq.sujoIni <= arq.sujoFim) {
+            size_t tam = (size_t)(arq.sujoFim - arq.sujoIni + 1)*tamPagina;
+            {
+                MEDIR_ES();
+                // É o ponto de confirmação: uma falha não pode passar por durável
+                if (msync(arq.mapa + (size_t)arq.sujoIni*tamPagina, tam, MS_SYNC) != 0) {
+                    cerr << "Erro: falha ao sincronizar o arquivo mapeado!\n";
+                    exit(1);
+                }
+            }
+            arq.bytesGravados += tam;
+            CONTAR(CONT_SINCRONIZACOES, 1);
+            CONTAR(CONT_BYTES_GRAVADOS, tam);
+            arq.sujoIni = arq.cab.cabecalho.tam + 1;
+            arq.sujoFim = -1;
+        }
+        return;
+    }
+
+    lock_guard<mutex> trava(arq.mCache);
+    for (size_t i = 0; i < arq.quadros.size(); i++) {
+        quadro &q = arq.quadros[i];
+        if (q.pos != -1 && q.sujo) {
+            gravarQuadro(arq, i);
+            q.sujo = false;
+        }
+    }
+    if (arq.cabSujo) {
+        gravarDados(arq, &arq.cab, sizeof(arq.cab.cabecalho), 0);
+        arq.cabSujo = false;
+    }
+}
+
+#define ASSINATURA_LOG 0x4c415742    ///< Início de um bloco do log ("BWAL")
+#define LIMITE_LOG (64LL << 20)      ///< Tamanho do log que dispara um checkpoint (bytes)
+
+/**
+ * @struct blocoLog
+ * @brief Cabeçalho de um bloco do log de escrita antecipada
+ *
+ * Um bloco guarda a imagem final de todas as páginas alteradas por uma
+ * operação (o cabeçalho do arquivo vai como página 0). Cada página ocupa
+ * um int com o seu número seguido de tamPagina bytes. O bloco só vale se
+ * estiver completo e a soma conferir, então um bloco cortado por uma
+ * queda é descartado inteiro.
+ */
+struct blocoLog {
+    int assinatura;     ///< ASSINATURA_LOG
+    int paginas;        ///< Quantidade de páginas no bloco
+    int tamPagina;      ///< Tamanho de cada página em bytes
+    unsigned soma;      ///< Soma FNV-1a do conteúdo após o cabeçalho
+};
+
+/**
+ * @brief Soma de verificação FNV-1a
+ * @param p Início dos bytes
+ * @param n Quantidade de bytes
+ */
+unsigned somaFnv(const char *p, size_t n) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Anexa um bloco ao buffer do log
+ * @param arq Arquivo aberto
+ * @param bloco Bloco completo (cabeçalho e páginas)
+ * @return Número do bloco, a ser passado para esperarLog
+ */
+long long anexarLog(arquivo &arq, const vector<char> &bloco) {
+    lock_guard<mutex> trava(arq.mLog);
+    arq.bufLog.insert(arq.bufLog.end(), bloco.begin(), bloco.end());
+    return ++arq.lsnAnexado;
+}
+
+/**
+ * @brief Espera até que o bloco indicado esteja no disco
+ * @param arq Arquivo aberto
+ * @param lsn Número devolvido por anexarLog
+ *
+ * Confirmação em grupo: quem encontra o log livre grava de uma vez tudo o
+ * que estiver acumulado no buffer, com um único write e um único
+ * fdatasync. Quem chega enquanto uma gravação está em andamento apenas
+ * espera a próxima, que levará o seu bloco junto com os demais. Uma falha
+ * no write ou no fdatasync encerra o programa antes de lsnDuravel avançar:
+ * nenhuma confirmação do grupo é dada como durável.
+ */
+void esperarLog(arquivo &arq, long long lsn) {
+    unique_lock<mutex> trava(arq.mLog);
+    while (arq.lsnDuravel < lsn) {
+        if (arq.gravandoLog) {
+            arq.cvLog.wait(trava);
+            continue;
+        }
+
+        // Este chamador lidera a gravação do grupo acumulado
+        arq.gravandoLog = true;
+        vector<char> grupo;
+        grupo.swap(arq.bufLog);
+        long long ultimo = arq.lsnAnexado;
+        trava.unlock();
+
+        {
+            MEDIR_ES();
+            size_t feito = 0;
+            while (feito < grupo.size()) {
+                ssize_t n = write(arq.fdLog, grupo.data() + feito, grupo.size() - feito);
+                if (n <= 0) {
+                    cerr << "Erro: falha ao gravar o log!\n";
+                    exit(1);
+                }
+                feito += n;
+                CONTAR(CONT_GRAVACOES, 1);
+            }
+            // Sem o fdatasync, nada do grupo pode ser dado como durável
+            if (fdatasync(arq.fdLog) != 0) {
+                cerr << "Erro: falha ao sincronizar o log!\n";
+                exit(1);
+            }
+        }
+        arq.bytesGravados += grupo.size();
+        CONTAR(CONT_BYTES_GRAVADOS, grupo.size());
+        CONTAR(CONT_SINCRONIZACOES, 1);
+
+        trava.lock();
+        arq.tamLog += grupo.size();
+        arq.lsnDuravel = ultimo;
+        arq.gravandoLog = false;
+        arq.cvLog.notify_all();
+    }
+}
+
+/**
+ * @brief Garante à thread atual a vez de escrita no arquivo
+ * @param arq Arquivo aberto
+ *
+ * Chamada no início de cada operação que altera a árvore; a vez só é
+ * devolvida por confirmar (ou terminarEscrita), de modo que várias
+ * operações da mesma thread antes de uma confirmação formam uma só.
+ */
+void iniciarEscrita(arquivo &arq) {
+    if (minhaThread.escrita) return;
+    arq.mEscrita.lock();
+    minhaThread.escrita = true;
+}
+
+void construirFiltro(arquivo &arq);
+
+/**
+ * @brief Devolve a vez de escrita obtida por iniciarEscrita
+ * @param arq Arquivo aberto
+ *
+ * Cada vez devolvida encerra uma época: os instantâneos abertos a partir
+ * daí veem tudo o que a escrita fez. Se a escrita deixou o filtro de
+ * Bloom com mais chaves do que as previstas, ele é refeito antes de a vez
+ * ser solta: a thread lê as folhas como um leitor (travas compartilhadas,
+ * sem imagens para os instantâneos), mas nenhuma escrita pode acrescentar
+ * uma chave a um filtro que já vai ser trocado.
+ */
+void terminarEscrita(arquivo &arq) {
+    if (!minhaThread.escrita) return;
+    arq.epoca++;
+    minhaThread.escrita = false;
+    if (arq.filtro.atual.load(memory_order_relaxed) != NULL && arq.filtro.chaves > arq.filtro.capacidade) {
+        construirFiltro(arq);
+    }
+    arq.mEscrita.unlock();
+}
+
+/**
+ * @brief Grava as páginas no arquivo de dados e esvazia o log
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ *
+ * Depois do fsync de pagina.dat todas as operações confirmadas estão no
+ * arquivo de dados, então o log pode ser truncado. Antes, espera os
+ * blocos ainda no buffer, para que nenhum seja gravado depois do corte.
+ */
+void checkpoint(arquivo &arq) {
+    ESTATISTICA(arq, ESTAT_CONFIRMACAO);
+    if (arq.fdLog != -1) {
+        long long ultimo;
+        {
+            lock_guard<mutex> trava(arq.mLog);
+            ultimo = arq.lsnAnexado;
+        }
+        esperarLog(arq, ultimo);
+    }
+    descarregar(arq);
+    if (arq.fdLog == -1) return;
+    MEDIR_ES();
+    // O log só pode ser cortado depois que as páginas estão no disco
+    if (fsync(arq.fdDados) != 0) {
+        cerr << "Erro: falha ao sincronizar o arquivo de dados!\n";
+        exit(1);
+    }
+    lock_guard<mutex> trava(arq.mLog);
+    if (ftruncate(arq.fdLog, 0) != 0 || fsync(arq.fdLog) != 0) {
+        cerr << "Erro: falha ao esvaziar o log!\n";
+        exit(1);
+    }
+    arq.tamLog = 0;
+    CONTAR(CONT_SINCRONIZACOES, 2);
+}
+
+/**
+ * @brief Ponto de confirmação de uma operação
+ * @param arq Arquivo aberto
+ *
+ * Com o log ligado, grava no log a imagem de cada página alterada desde a
+ * confirmação anterior e do cabeçalho; as páginas continuam sujas no
+ * cache e só chegam a pagina.dat quando forem substituídas ou no próximo
+ * checkpoint. No arquivo mapeado, sincroniza as páginas com msync.
+ *
+ * A vez de escrita é devolvida logo depois de o bloco entrar no buffer do
+ * log, antes do fdatasync: o próximo escritor já pode trabalhar e o seu
+ * bloco tende a ir no mesmo grupo. Sem a vez de escrita, não há nada da
+ * thread a confirmar.
+ */
+void confirmar(arquivo &arq) {
+    if (!minhaThread.escrita) return;
+    ESTATISTICA(arq, ESTAT_CONFIRMACAO);
+    if (arq.mapa) {
+        descarregar(arq);
+        terminarEscrita(arq);
+        return;
+    }
+    if (arq.fdLog == -1 || (arq.alteradas.empty() && !arq.cabSujo)) {
+        terminarEscrita(arq);
+        return;
+    }
+
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    int paginas = arq.alteradas.size() + 1;
+    size_t tamItem = sizeof(int) + tamPagina;
+    vector<char> bloco(sizeof(blocoLog) + paginas*tamItem, 0);
+    char *p = bloco.data() + sizeof(blocoLog);
+
+    // Cabeçalho como página 0, seguido das páginas alteradas
+    int zero = 0;
+    memcpy(p, &zero, sizeof(int));
+    memcpy(p + sizeof(int), &arq.cab, sizeof(arq.cab.cabecalho));
+    p += tamItem;
+    long long lsn;
+    {
+        // Sob mCache até o bloco ter número: cada quadro passa de pendente
+        // a esperando o bloco sem ficar livre para ser gravado no meio
+        lock_guard<mutex> trava(arq.mCache);
+        for (size_t k = 0; k < arq.alteradas.size(); k++) {
+            int pos = arq.alteradas[k];
+            memcpy(p, &pos, sizeof(int));
+            memcpy(p + sizeof(int), &arq.memoria[arq.tabela[pos]], tamPagina);
+            p += tamItem;
+        }
+
+        blocoLog b = {ASSINATURA_LOG, paginas, tamPagina, 0};
+        b.soma = somaFnv(bloco.data() + sizeof(blocoLog), bloco.size() - sizeof(blocoLog));
+        memcpy(bloco.data(), &b, sizeof(blocoLog));
+        lsn = anexarLog(arq, bloco);
+
+        for (size_t k = 0; k < arq.alteradas.size(); k++) {
+            quadro &q = arq.quadros[arq.tabela[arq.alteradas[k]]];
+            q.pendente = false;
+            q.lsn = lsn;
+        }
+        arq.alteradas.clear();
+    }
+    terminarEscrita(arq);
+    esperarLog(arq, lsn);
+
+    bool cheio;
+    {
+        lock_guard<mutex> trava(arq.mLog);
+        cheio = arq.tamLog > LIMITE_LOG;
+    }
+    if (cheio) {
+        iniciarEscrita(arq);
+        checkpoint(arq);
+        terminarEscrita(arq);
+    }
+}
+
+/**
+ * @brief Reaplica no arquivo de dados os blocos completos do log
+ * @param dados Caminho de pagina.dat
+ * @param log Caminho do log
+ * @return Quantidade de blocos reaplicados
+ *
+ * Chamada na abertura, antes de ler o cabeçalho. Os blocos são lidos em
+ * ordem até o fim do log ou até o primeiro bloco incompleto ou com soma
+ * errada (a operação que estava sendo gravada na queda, nunca confirmada).
+ * As imagens das páginas são gravadas nas suas posições, o arquivo é
+ * sincronizado e o log é esvaziado.
+ */
+int recuperarLog(const char *dados, const char *log) {
+    int fl = open(log, O_RDWR);
+    if (fl == -1) return 0;
+    int fd = open(dados, O_RDWR);
+    if (fd == -1) {
+        close(fl);
+        return 0;
+    }
+
+    int aplicados = 0;
+    blocoLog b;
+    while (read(fl, &b, sizeof(b)) == (ssize_t)sizeof(b)) {
+        if (b.assinatura != ASSINATURA_LOG || b.paginas <= 0 ||
+            (b.tamPagina != 4096 && b.tamPagina != 8192)) break;
+        size_t tamItem = sizeof(int) + b.tamPagina;
+        vector<char> conteudo(b.paginas*tamItem);
+        if (read(fl, conteudo.data(), conteudo.size()) != (ssize_t)conteudo.size()) break;
+        if (somaFnv(conteudo.data(), conteudo.size()) != b.soma) break;
+
+        for (int k = 0; k < b.paginas; k++) {
+            int pos;
+            memcpy(&pos, &conteudo[k*tamItem], sizeof(int));
+            size_t tam = (pos == 0) ? sizeof(((pagina*)0)->cabecalho) : (size_t)b.tamPagina;
+            if (pwrite(fd, &conteudo[k*tamItem + sizeof(int)], tam, (off_t)pos*b.tamPagina) != (ssize_t)tam) {
+                cerr << "Erro: falha ao reaplicar o log!\n";
+                exit(1);
+            }
+        }
+        aplicados++;
+    }
+
+    if (fsync(fd) != 0) {
+        cerr << "Erro: falha ao sincronizar o arquivo de dados!\n";
+        exit(1);
+    }
+    if (ftruncate(fl, 0) != 0 || fsync(fl) != 0) {
+        cerr << "Erro: falha ao esvaziar o log!\n";
+        exit(1);
+    }
+    close(fd);
+    close(fl);
+    return aplicados;
+}
+
+/**
+ * @brief Libera as fixações das páginas internas de um caminho
+ * @param arq Arquivo aberto
+ * @param c Caminho preenchido por descer
+ *
+ * Também solta mRaiz, se o caminho ainda começa na raiz e é o último da
+ * thread a mantê-la. A folha
+ * (c.folha) continua fixada e é desafixada à parte.
+ */
+void soltarCaminho(arquivo &arq, caminho &c) {
+    for (int nivel = 0; nivel < c.altura; nivel++) {
+        desafixar(arq, c.pos[nivel], false);
+    }
+    c.altura = 0;
+    if (c.raiz) {
+        if (--minhaThread.raiz == 0) arq.mRaiz.unlock();
+        c.raiz = false;
+    }
+}
+
+/**
+ * @brief Percorre a lista de livres e monta o mapa por endereço
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ *
+ * O mapa guarda as páginas livres em ordem crescente e, para cada uma, a
+ * anterior na lista, para que qualquer página possa sair da lista sem
+ * percorrê-la. É usado pela alocação por endereço e pela compactação;
+ * depois de montado, alocarPagina e liberarPagina o mantêm.
+ *
+ * Complexidade: O(f) páginas lidas para f páginas na lista
+ */
+void mapearLivres(arquivo &arq) {
+    arq.livresOrdem.clear();
+    arq.anteriorLivre.clear();
+    int anterior = -1;
+    int pos = arq.cab.cabecalho.free;
+    while (pos != -1) {
+        arq.livresOrdem.insert(pos);
+        arq.anteriorLivre[pos] = anterior;
+        pagina *l = fixar(arq, pos);
+        int proxima = l->livre.next;
+        desafixar(arq, pos, false);
+        anterior = pos;
+        pos = proxima;
+    }
+    arq.mapaLivres = true;
+}
+
+/**
+ * @brief Tira uma página de qualquer ponto da lista de livres
+ * @param arq Arquivo aberto, com o mapa da lista montado (mapearLivres)
+ * @param pos Página livre a retirar
+ *
+ * Não altera cab.cabecalho.livres: quem chama decide se a página passa a
+ * ser usada ou fica além da marca alto.
+ *
+ * Complexidade: O(1) páginas lidas
+ */
+void retirarLivre(arquivo &arq, int pos) {
+    pagina &cab = arq.cab;
+    pagina *l = fixar(arq, pos);
+    int proxima = l->livre.next;
+    desafixar(arq, pos, false);
+    int anterior = arq.anteriorLivre[pos];
+    if (anterior == -1) {
+        cab.cabecalho.free = proxima;
+        arq.cabSujo = true;
+    } else {
+        pagina *a = fixar(arq, anterior);
+        a->livre.next = proxima;
+        desafixar(arq, anterior, true);
+    }
+    if (proxima != -1) arq.anteriorLivre[proxima] = anterior;
+    arq.anteriorLivre.erase(pos);
+    arq.livresOrdem.erase(pos);
+}
+
+/**
+ * @brief Retira uma página da lista de páginas livres
+ * @param arq Arquivo aberto (cabeçalho atualizado em memória)
+ * @param perto Página junto da qual a nova deve ficar (-1 se tanto faz)
+ * @return Número da página alocada
+ *
+ * Na política ALOCACAO_ENDERECO, com perto indicado, escolhe a página
+ * livre de número mais próximo de perto (na lista ou logo depois da
+ * marca alto), para que folhas vizinhas na ordem das chaves também fiquem
+ * vizinhas no arquivo. Na política ALOCACAO_PILHA, ou sem perto, usa a
+ * cabeça da lista.
+ *
+ * Com a lista vazia, entrega a página seguinte à marca alto, que nunca
+ * foi usada e por isso não precisa estar encadeada. Quem chama deve
+ * garantir antes que cab.cabecalho.livres é suficiente. Se a compactação
+ * já mapeou a lista (arq.mapaLivres), o mapa acompanha a retirada.
+ */
+int alocarPagina(arquivo &arq, int perto = -1) {
+    pagina &cab = arq.cab;
+    arq.folhasOrdenadas = 0;  // A lista de folhas pode mudar: a compactação recomeça a conferência
+
+    if (arq.alocacao == ALOCACAO_ENDERECO && perto != -1 && cab.cabecalho.free != -1) {
+        if (!arq.mapaLivres) mapearLivres(arq);
+        int melhor = cab.cabecalho.alto < cab.cabecalho.tam ? cab.cabecalho.alto + 1 : -1;
+        set<int>::iterator it = arq.livresOrdem.lower_bound(perto);
+        if (it != arq.livresOrdem.end() && (melhor == -1 || *it - perto < abs(melhor - perto))) melhor = *it;
+        if (it != arq.livresOrdem.begin() && (melhor == -1 || perto - *prev(it) < abs(melhor - perto))) {
+            melhor = *prev(it);
+        }
+        if (melhor != cab.cabecalho.alto + 1) {
+            retirarLivre(arq, melhor);
+            cab.cabecalho.livres--;
+            arq.cabSujo = true;
+            return melhor;
+        }
+    }
+    if (cab.cabecalho.free == -1) {
+        cab.cabecalho.livres--;
+        arq.cabSujo = true;
+        return ++cab.cabecalho.alto;
+    }
+    int pos = cab.cabecalho.free;
+    pagina *l = fixar(arq, pos);
+    cab.cabecalho.free = l->livre.next;
+    cab.cabecalho.livres--;
+    arq.cabSujo = true;
+    desafixar(arq, pos, false);
+    if (arq.mapaLivres) {
+        arq.livresOrdem.erase(pos);
+        arq.anteriorLivre.erase(pos);
+        if (cab.cabecalho.free != -1) arq.anteriorLivre[cab.cabecalho.free] = -1;
+    }
+    return pos;
+}
+
+/**
+ * @brief Devolve uma página à lista de páginas livres
+ * @param arq Arquivo aberto (cabeçalho atualizado em memória)
+ * @param pos Número da página liberada
+ *
+ * A página entra na cabeça da lista (e no mapa da compactação, se existe).
+ */
+void liberarPagina(arquivo &arq, int pos) {
+    pagina &cab = arq.cab;
+    arq.folhasOrdenadas = 0;
+    pagina *l = fixar(arq, pos);
+    memset(l, 0, cab.cabecalho.tamPagina);
+    l->livre.tipo = PAGINA_LIVRE;
+    l->livre.next = cab.cabecalho.free;
+    l->livre.prev = -1;
+    desafixar(arq, pos, true);
+    if (arq.mapaLivres) {
+        arq.livresOrdem.insert(pos);
+        arq.anteriorLivre[pos] = -1;
+        if (cab.cabecalho.free != -1) arq.anteriorLivre[cab.cabecalho.free] = pos;
+    }
+    cab.cabecalho.free = pos;
+    cab.cabecalho.livres++;
+    arq.cabSujo = true;
+}
+
+/**
+ * @brief Bytes de valor que cabem em uma página de excedente
+ * @param tamPagina Tamanho da página em bytes
+ */
+int valorPorPagina(int tamPagina) {
+    return tamPagina - 4*sizeof(int) - sizeof(tipoChave);
+}
+
+/**
+ * @brief Páginas de excedente que um valor ocupa
+ * @param arq Arquivo aberto
+ * @param tamValor Tamanho do valor em bytes
+ * @return 0 se o valor cabe na folha (até o limiar)
+ */
+int paginasValor(arquivo &arq, int tamValor) {
+    if (tamValor <= arq.cab.cabecalho.limiar) return 0;
+    int porPagina = valorPorPagina(arq.cab.cabecalho.tamPagina);
+    return (tamValor + porPagina - 1) / porPagina;
+}
+
+/**
+ * @brief Monta a célula de um registro, gravando o excedente se preciso
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ * @param d Registro
+ * @param perto Página junto da qual o excedente deve ficar (-1 se tanto faz)
+ * @return Célula pronta para ir para a folha
+ *
+ * Um valor maior que o limiar é dividido em páginas de excedente
+ * encadeadas, e a célula guarda só a referência. Quem chama deve garantir
+ * antes que há paginasValor páginas livres.
+ *
+ * Complexidade: O(v / B) páginas gravadas para um valor de v bytes
+ */
+celula prepararCelula(arquivo &arq, const dados &d, int perto = -1) {
+    celula c;
+    c.chave = d.chave;
+    c.excedente = false;
+    int n = paginasValor(arq, d.nome.size());
+    if (n == 0) {
+        c.carga = d.nome;
+        return c;
+    }
+    int porPagina = valorPorPagina(arq.cab.cabecalho.tamPagina);
+    vector<int> paginas(n);
+    for (int k = 0; k < n; k++) {
+        paginas[k] = alocarPagina(arq, k ? paginas[k - 1] : perto);
+    }
+    for (int k = 0; k < n; k++) {
+        pagina *p = fixar(arq, paginas[k], true);
+        int quant = std::min(porPagina, (int)d.nome.size() - k*porPagina);
+        p->excedente.tipo = PAGINA_EXCEDENTE;
+        p->excedente.quant = quant;
+        p->excedente.next = k + 1 < n ? paginas[k + 1] : -1;
+        p->excedente.prev = k ? paginas[k - 1] : -1;
+        p->excedente.chave = d.chave;
+        memcpy(p->excedente.valor, d.nome.data() + k*porPagina, quant);
+        desafixar(arq, paginas[k], true);
+    }
+    referenciaExcedente r = { (int)d.nome.size(), paginas[0] };
+    c.excedente = true;
+    c.carga.assign((char*)&r, sizeof(r));
+    return c;
+}
+
+/**
+ * @brief Libera as páginas de excedente de uma célula
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ * @param c Célula retirada da folha (sem efeito se o valor está na folha)
+ */
+void liberarCelula(arquivo &arq, const celula &c) {
+    if (!c.excedente) return;
+    int pos = lerReferencia(c).pagina;
+    while (pos != -1) {
+        pagina *p = fixar(arq, pos);
+        int proxima = p->excedente.next;
+        desafixar(arq, pos, false);
+        liberarPagina(arq, pos);
+        pos = proxima;
+    }
+}
+
+/**
+ * @brief Valor completo de uma célula
+ * @param arq Arquivo aberto
+ * @param c Célula lida com a folha ainda fixada, para que o excedente não
+ *          seja liberado durante a leitura
+ *
+ * Complexidade: O(v / B) páginas lidas para um valor de v bytes
+ */
+string valorCelula(arquivo &arq, const celula &c) {
+    if (!c.excedente) return c.carga;
+    referenciaExcedente r = lerReferencia(c);
+    string valor;
+    valor.reserve(r.comprimento);
+    for (int pos = r.pagina; pos != -1; ) {
+        pagina *p = fixar(arq, pos);
+        valor.append(p->excedente.valor, p->excedente.quant);
+        int proxima = p->excedente.next;
+        desafixar(arq, pos, false);
+        pos = proxima;
+    }
+    return valor;
+}
+
+/**
+ * @struct instantaneo
+ * @brief Visão do arquivo congelada entre duas escritas
+ *
+ * Obtido por abrirInstantaneo e lido por lerInstantaneo, página a página, sem
+ * impedir as escritas: cada página que o escritor altera depois da
+ * abertura tem a imagem anterior guardada enquanto houver um instantâneo
+ * que possa precisar dela.
+ */
+struct instantaneo {
+    long long epoca;  ///< Escritas terminadas quando o instantâneo foi aberto
+    pagina cab;       ///< Cabeçalho naquele momento
+};
+
+/**
+ * @brief Abre um instantâneo do estado atual do arquivo
+ * @param arq Arquivo aberto (buffer pool), sem a vez de escrita com a thread atual
+ * @param inst Recebe o instantâneo; deve ser fechado por fecharInstantaneo
+ *
+ * Espera a escrita em andamento terminar, para que a visão fique entre
+ * duas escritas.
+ */
+void abrirInstantaneo(arquivo &arq, instantaneo &inst) {
+    iniciarEscrita(arq);
+    inst.epoca = arq.epoca;
+    memcpy(&inst.cab, &arq.cab, sizeof(arq.cab.cabecalho));
+    {
+        lock_guard<mutex> trava(arq.mVersoes);
+        arq.instantaneos.insert(inst.epoca);
+        arq.quantInstantaneos.store(arq.instantaneos.size(), memory_order_relaxed);
+    }
+    terminarEscrita(arq);
+}
+
+/**
+ * @brief Fecha um instantâneo e descarta as imagens que ninguém mais usa
+ * @param arq Arquivo aberto
+ * @param inst Instantâneo aberto por abrirInstantaneo
+ *
+ * Uma imagem só serve a instantâneos de antes da escrita ate; quando o
+ * mais antigo dos que continuam abertos é dessa escrita ou de depois,
+ * ela é descartada.
+ *
+ * Complexidade: O(p) para p páginas com imagens guardadas
+ */
+void fecharInstantaneo(arquivo &arq, instantaneo &inst) {
+    lock_guard<mutex> trava(arq.mVersoes);
+    multiset<long long>::iterator it = arq.instantaneos.find(inst.epoca);
+    if (it == arq.instantaneos.end()) return;
+    arq.instantaneos.erase(it);
+    arq.quantInstantaneos.store(arq.instantaneos.size(), memory_order_relaxed);
+    if (arq.instantaneos.empty()) {
+        arq.versoes.clear();
+        return;
+    }
+    long long maisAntigo = *arq.instantaneos.begin();
+    for (unordered_map<int, vector<versaoPagina>>::iterator v = arq.versoes.begin(); v != arq.versoes.end(); ) {
+        vector<versaoPagina> &lista = v->second;
+        size_t k = 0;
+        while (k < lista.size() && lista[k].ate <= maisAntigo) k++;
+        lista.erase(lista.begin(), lista.begin() + k);
+        if (lista.empty()) v = arq.versoes.erase(v);
+        else ++v;
+    }
+}
+
+/**
+ * @brief Copia uma página como ela estava na abertura de um instantâneo
+ * @param arq Arquivo aberto
+ * @param inst Instantâneo aberto
+ * @param pos Número da página
+ * @param destino Recebe a página
+ *
+ * A página fica fixada (com trava de leitura) só durante a cópia. Sob a
+ * trava, o escritor não pode estar no meio de uma alteração: ou a imagem
+ * de antes dela já foi guardada, ou a página ainda está como o
+ * instantâneo a viu. Vale a imagem mais antiga entre as guardadas depois
+ * da abertura.
+ *
+ * Complexidade: O(1) páginas lidas
+ */
+void lerInstantaneo(arquivo &arq, const instantaneo &inst, int pos, pagina &destino) {
+    int tamPagina = inst.cab.cabecalho.tamPagina;
+    pagina *p = fixar(arq, pos);
+    {
+        lock_guard<mutex> trava(arq.mVersoes);
+        unordered_map<int, vector<versaoPagina>>::iterator v = arq.versoes.find(pos);
+        const char *origem = (const char*)p;
+        if (v != arq.versoes.end()) {
+            for (size_t k = 0; k < v->second.size(); k++) {
+                if (v->second[k].ate > inst.epoca) {
+                    origem = v->second[k].bytes.data();
+                    break;
+                }
+            }
+        }
+        memcpy(&destino, origem, tamPagina);
+    }
+    desafixar(arq, pos, false);
+}
+
+/**
+ * @brief Valor completo de uma célula lida de um instantâneo
+ * @param arq Arquivo aberto
+ * @param inst Instantâneo em que a célula foi lida
+ * @param c Célula
+ *
+ * Complexidade: O(v / B) páginas lidas para um valor de v bytes
+ */
+string valorInstantaneo(arquivo &arq, const instantaneo &inst, const celula &c) {
+    if (!c.excedente) return c.carga;
+    referenciaExcedente r = lerReferencia(c);
+    string valor;
+    valor.reserve(r.comprimento);
+    pagina p;
+    for (int pos = r.pagina; pos != -1; pos = p.excedente.next) {
+        lerInstantaneo(arq, inst, pos, p);
+        valor.append(p.excedente.valor, p.excedente.quant);
+    }
+    return valor;
+}
+
+/**
+ * @brief Estende o arquivo até a página indicada, sem gravar as anteriores
+ * @param f Arquivo aberto
+ * @param ultima Número da última página
+ * @param tamPagina Tamanho da página em bytes
+ * @return true se a escrita deu certo
+ *
+ * Grava apenas a última página (zerada); as páginas intermediárias ficam
+ * como um buraco no arquivo e são lidas como zeros.
+ */
+bool estenderArquivo(fstream &f, int ultima, int tamPagina) {
+    pagina vazia;
+    memset(&vazia, 0, tamPagina);
+    f.clear();
+    f.seekp((streamoff)ultima*tamPagina, f.beg);
+    f.write((char*)&vazia, tamPagina);
+    f.flush();
+    if (!f) {
+        f.clear();
+        return false;
+    }
+    return true;
+}
+
+#define CRESCIMENTO_MIN 16  ///< Menor quantidade de páginas acrescentadas de uma vez
+
+/**
+ * @brief Aumenta o arquivo com novas páginas livres
+ * @param arq Arquivo aberto
+ * @param minimo Quantidade mínima de páginas livres necessárias
+ * @return true se o arquivo cresceu
+ *
+ * O crescimento é geométrico: o arquivo ganha tantas páginas quanto já
+ * tem (no mínimo CRESCIMENTO_MIN e no mínimo o que falta). As novas
+ * páginas ficam além da marca alto, então não precisam ser encadeadas:
+ * basta estender o arquivo e aumentar tam. No arquivo mapeado, o
+ * mapeamento é refeito com o novo tamanho, então nenhum ponteiro para
+ * páginas pode estar em uso durante a chamada.
+ *
+ * Complexidade: O(1)
+ */
+bool crescerArquivo(arquivo &arq, int minimo) {
+    pagina &cab = arq.cab;
+    int tamPagina = cab.cabecalho.tamPagina;
+    int falta = minimo - cab.cabecalho.livres;
+    int novas = std::max(std::max(cab.cabecalho.tam, CRESCIMENTO_MIN), falta);
+    pagina vazia;
+    memset(&vazia, 0, tamPagina);
+    off_t fim = (off_t)(cab.cabecalho.tam + novas)*tamPagina;
+    {
+        MEDIR_ES();
+        if (pwrite(arq.fdDados, &vazia, tamPagina, fim) != tamPagina) return false;
+    }
+    arq.bytesGravados += tamPagina;
+    CONTAR(CONT_GRAVACOES, 1);
+    CONTAR(CONT_BYTES_GRAVADOS, tamPagina);
+
+    // Arquivo mapeado: refaz o mapeamento cobrindo as novas páginas
+    if (arq.mapa) {
+        size_t tamMapa = (size_t)(cab.cabecalho.tam + novas + 1)*tamPagina;
+        void *m = mremap(arq.mapa, arq.tamMapa, tamMapa, MREMAP_MAYMOVE);
+        if (m == MAP_FAILED) return false;
+        arq.mapa = (char*)m;
+        arq.tamMapa = tamMapa;
+    }
+
+    cab.cabecalho.livres += novas;
+    cab.cabecalho.tam += novas;
+    arq.cabSujo = true;
+    return true;
+}
+
+/**
+ * @brief Quantidade de páginas (sem o cabeçalho) que garante espaço para n registros
+ * @param n Número máximo de registros
+ * @param tamPagina Tamanho da página em bytes
+ *
+ * Supõe folhas e páginas internas com a ocupação mínima (metade) e
+ * valores de 30 bytes, guardados na própria folha.
+ */
+int paginasNecessarias(int n, int tamPagina) {
+    int minFolha = std::max(1, minimoFolha(tamPagina, LIMIAR_PADRAO) / tamanhoRegistro(30));
+    int minFilhos = capacidadeInterna(tamPagina) / 2 + 1;
+    int paginas = n / minFolha + 1;
+    for (int x = paginas; x > 1; ) {
+        x = (x + minFilhos - 1) / minFilhos;
+        paginas += x;
+    }
+    return paginas;
+}
+
+/**
+ * @brief Inicializa um novo arquivo para a Árvore B+
+ * @param arq Referência para o arquivo já aberto
+ * @param n Número máximo de registros que o arquivo pode armazenar
+ * @param tamPagina Tamanho de cada página em bytes (4096 ou 8192)
+ * @param limiar Maior valor guardado na própria folha (limiarValido)
+ *
+ * Esta função:
+ * 1. Calcula quantas páginas são necessárias para n registros, supondo
+ *    folhas e páginas internas com a ocupação mínima (metade)
+ * 2. Configura o cabeçalho com valores iniciais
+ * 3. Cria a raiz como uma folha vazia
+ * 4. Estende o arquivo até o tamanho final sem gravar as demais páginas:
+ *    como ficam além da marca alto, nunca foram usadas e não precisam
+ *    estar na lista de livres
+ *
+ * Complexidade: O(1)
+ */
+void inicializar(fstream &arq, int n, int tamPagina, int limiar) {
+    pagina cab, l;
+
+    // Folhas e páginas internas ocupadas pela metade no pior caso
+    int paginas = paginasNecessarias(n, tamPagina);
+
+    // Configuração inicial do cabeçalho
+    memset(&cab, 0, tamPagina);
+    cab.cabecalho.quant = 0;            // Nenhum registro inserido
+    cab.cabecalho.first = 1;            // A raiz é a única folha
+    cab.cabecalho.last = 1;
+    cab.cabecalho.free = -1;            // Lista de livres vazia
+    cab.cabecalho.tam = paginas;        // Capacidade total
+    cab.cabecalho.raiz = 1;
+    cab.cabecalho.altura = 0;
+    cab.cabecalho.tamPagina = tamPagina;
+    cab.cabecalho.livres = paginas - 1;
+    cab.cabecalho.assinatura = tracos::assinatura;
+    cab.cabecalho.alto = 1;             // Só a raiz foi usada
+    cab.cabecalho.limiar = limiar;
+    cab.cabecalho.frias = 0;
+
+    // Escreve o cabeçalho ocupando a página 0 inteira
+    arq.seekp(0, arq.beg);
+    arq.write((char*)&cab, tamPagina);
+
+    // Raiz: folha vazia
+    memset(&l, 0, tamPagina);
+    l.folha.tipo = PAGINA_FOLHA;
+    l.folha.quant = 0;
+    l.folha.next = -1;
+    l.folha.prev = -1;
+    l.folha.topo = tamPagina;
+    arq.write((char*)&l, tamPagina);
+
+    // Reserva as demais páginas apenas estendendo o arquivo
+    if (paginas > 1) estenderArquivo(arq, paginas, tamPagina);
+}
+
+#define PAGINAS_POR_ESCRITA 64  ///< Páginas acumuladas por escrita na carga em massa
+
+/**
+ * @struct gravador
+ * @brief Acumula páginas consecutivas e as grava com uma única escrita
+ *
+ * Usado pela carga em massa, que produz as páginas na ordem do arquivo;
+ * assim o arquivo é escrito de forma puramente sequencial.
+ */
+struct gravador {
+    fstream *f;         ///< Arquivo de destino, posicionado na próxima página
+    int tamPagina;      ///< Tamanho da página em bytes
+    int proxima;        ///< Número da próxima página a ser acrescentada
+    vector<char> buf;   ///< Páginas ainda não gravadas
+};
+
+/**
+ * @brief Grava as páginas acumuladas
+ * @param g Gravador
+ */
+void esvaziar(gravador &g) {
+    if (!g.buf.empty()) g.f->write(g.buf.data(), g.buf.size());
+    g.buf.clear();
+}
+
+/**
+ * @brief Acrescenta a próxima página do arquivo
+ * @param g Gravador
+ * @param p Conteúdo da página (recebe o número g.proxima)
+ */
+void acrescentar(gravador &g, pagina &p) {
+    g.buf.insert(g.buf.end(), p.bytes, p.bytes + g.tamPagina);
+    g.proxima++;
+    if (g.buf.size() >= (size_t)PAGINAS_POR_ESCRITA*g.tamPagina) esvaziar(g);
+}
+
+/**
+ * @brief Lê o próximo registro da entrada da carga em massa
+ * @param in Arquivo de entrada
+ * @param csv Se true, a entrada é texto "chave,nome" por linha; senão,
+ *            registros registroBinario
+ * @param d Registro lido
+ * @return false no fim da entrada ou se uma chave não cabe em tipoChave
+ *         (nesse caso, in fica com badbit)
+ *
+ * No CSV, linhas que não começam por um número (como um cabeçalho) são
+ * ignoradas e nomes com mais de VALOR_MAX bytes são truncados.
+ */
+bool lerEntrada(ifstream &in, bool csv, dados &d) {
+    if (!csv) {
+        registroBinario r;
+        if (!in.read((char*)&r, sizeof(r))) return false;
+        d.chave = r.chave;
+        d.nome.assign(r.nome, strnlen(r.nome, sizeof(r.nome)));
+        return true;
+    }
+    string linha;
+    while (getline(in, linha)) {
+        char *fim;
+        tipoChave chave;
+        bool valida = tracos::ler(linha.c_str(), fim, chave);
+        if (fim == linha.c_str()) continue;
+        if (!valida) {
+            cout << "Erro: chave " << linha.substr(0, fim - linha.c_str()) << " fora do intervalo de " << tracos::minimo()
+                 << " a " << tracos::maximo() << "!\n";
+            in.setstate(ios::badbit);
+            return false;
+        }
+        d.chave = chave;
+        d.nome.clear();
+        if (*fim == ',') d.nome = linha.substr(fim + 1 - linha.c_str(), VALOR_MAX);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Acrescenta uma folha da carga em massa, já encadeada às vizinhas
+ * @param g Gravador
+ * @param l Folha com os registros preenchidos
+ * @param ultima Se true, a folha encerra a lista
+ * @param filhos Recebe a menor chave e o número da folha, para o índice
+ *
+ * As folhas são numeradas em sequência (depois das páginas de excedente),
+ * então a anterior e a próxima de cada folha são as páginas vizinhas.
+ */
+void acrescentarFolha(gravador &g, pagina &l, bool ultima, vector<entrada> &filhos) {
+    l.folha.tipo = PAGINA_FOLHA;
+    l.folha.prev = filhos.empty() ? -1 : g.proxima - 1;
+    l.folha.next = ultima ? -1 : g.proxima + 1;
+    entrada e = {l.folha.quant ? l.folha.chave[0] : 0, g.proxima};
+    filhos.push_back(e);
+    acrescentar(g, l);
+}
+
+/**
+ * @brief Divide os filhos de um nível em páginas internas com a ocupação desejada
+ * @param filhos Menor chave e página de cada filho, em ordem
+ * @param alvo Filhos por página conforme o fator de preenchimento
+ * @param max Máximo de filhos por página
+ * @param min Mínimo de filhos por página (exceto a raiz)
+ * @param alvoCompacta Filhos por página compacta conforme o fator de preenchimento
+ * @return Quantidade de filhos de cada página, da esquerda para a direita
+ *
+ * Cada página recebe alvoCompacta filhos quando as chaves deles cabem no
+ * alcance de uma página compacta (cabeCompacta) e alvo filhos quando não;
+ * a primeira e a última não têm limite de um dos lados e nunca são
+ * compactas. Se a última ficar abaixo do mínimo, ela é unida à anterior
+ * ou as duas dividem o total ao meio.
+ */
+vector<int> dividirNivel(const vector<entrada> &filhos, int alvo, int max, int min, int alvoCompacta) {
+    int m = filhos.size();
+    vector<int> grupos;
+    int ini = 0;
+    while (m - ini > alvo) {
+        int n = alvo;
+        if (ini > 0 && ini + alvoCompacta < m && cabeCompacta(filhos[ini].chave, filhos[ini + alvoCompacta].chave)) n = alvoCompacta;
+        grupos.push_back(n);
+        ini += n;
+    }
+    grupos.push_back(m - ini);
+    if (grupos.size() > 1 && grupos.back() < min) {
+        int total = grupos[grupos.size() - 2] + grupos.back();
+        grupos.pop_back();
+        if (total <= max) {
+            grupos.back() = total;
+        } else {
+            grupos.back() = total / 2;
+            grupos.push_back(total - total / 2);
+        }
+    }
+    return grupos;
+}
+
+/**
+ * @struct cabecalhoFiltro
+ * @brief Início do arquivo em que o filtro de Bloom é guardado entre execuções
+ *
+ * Logo depois vêm as 8*blocos palavras do filtro. O cabeçalho do arquivo
+ * de dados vai junto: o filtro só vale para o pagina.dat que tiver
+ * exatamente aquele cabeçalho.
+ */
+struct cabecalhoFiltro {
+    int assinatura;                         ///< ASSINATURA_FILTRO
+    unsigned soma;                          ///< Soma FNV-1a das palavras
+    long long blocos;                       ///< Blocos do filtro
+    long long capacidade;                   ///< Chaves previstas no dimensionamento
+    long long chaves;                       ///< Chaves acrescentadas desde a construção
+    decltype(pagina::cabecalho) dados;      ///< Cabeçalho do arquivo de dados
+};
+
+/**
+ * @brief Nome do arquivo do filtro de um arquivo de dados
+ * @param dados Caminho do arquivo de dados ("pagina.dat" dá "pagina.flt")
+ */
+string caminhoFiltro(const char *dados) {
+    string nome = dados;
+    if (nome.size() >= 4 && nome.compare(nome.size() - 4, 4, ".dat") == 0) nome.resize(nome.size() - 4);
+    return nome + ".flt";
+}
+
+/**
+ * @brief Grava o filtro de Bloom para a próxima abertura
+ * @param f Filtro
+ * @param cab Cabeçalho do arquivo de dados, já gravado nele
+ * @param nome Caminho do arquivo do filtro
+ *
+ * Um filtro que já recebeu mais chaves do que as previstas (o que só
+ * acontece depois da última escrita da execução) não é gravado: a
+ * próxima abertura o refaz com o tamanho certo.
+ */
+void gravarFiltro(const filtroBloom &f, const pagina &cab, const char *nome) {
+    remove(nome);
+    const tabelaFiltro *t = f.atual.load(memory_order_relaxed);
+    if (t == NULL || f.chaves > f.capacidade) return;
+    vector<unsigned> palavras(8*t->blocos);
+    for (size_t k = 0; k < palavras.size(); k++) palavras[k] = t->palavras[k].load(memory_order_relaxed);
+    cabecalhoFiltro c;
+    memset(&c, 0, sizeof(c));
+    c.assinatura = ASSINATURA_FILTRO;
+    c.soma = somaFnv((const char*)palavras.data(), palavras.size()*sizeof(unsigned));
+    c.blocos = t->blocos;
+    c.capacidade = f.capacidade;
+    c.chaves = f.chaves;
+    c.dados = cab.cabecalho;
+    ofstream o(nome, ios::binary | ios::trunc);
+    o.write((const char*)&c, sizeof(c));
+    o.write((const char*)palavras.data(), palavras.size()*sizeof(unsigned));
+    if (!o) {
+        o.close();
+        remove(nome);
+    }
+}
+
+/**
+ * @brief Lê o filtro de Bloom gravado no último fechamento
+ * @param f Recebe o filtro
+ * @param cab Cabeçalho do arquivo de dados recém-aberto
+ * @param nome Caminho do arquivo do filtro
+ * @return false se não há filtro gravado ou ele não vale para o arquivo
+ *
+ * Lido o filtro, o arquivo dele é apagado: se o programa for
+ * interrompido, o filtro gravado não teria as chaves inseridas depois, e
+ * a próxima abertura o refaz.
+ */
+bool carregarFiltro(filtroBloom &f, const pagina &cab, const char *nome) {
+    ifstream in(nome, ios::binary);
+    if (!in.is_open()) return false;
+    cabecalhoFiltro c;
+    in.read((char*)&c, sizeof(c));
+    bool valido = in && c.assinatura == ASSINATURA_FILTRO && c.blocos > 0 && c.blocos <= (1LL << 32) &&
+                  memcmp(&c.dados, &cab.cabecalho, sizeof(c.dados)) == 0;
+    vector<unsigned> palavras;
+    if (valido) {
+        palavras.resize(8*c.blocos);
+        in.read((char*)palavras.data(), palavras.size()*sizeof(unsigned));
+        valido = in && somaFnv((const char*)palavras.data(), palavras.size()*sizeof(unsigned)) == c.soma;
+    }
+    in.close();
+    remove(nome);
+    if (!valido) return false;
+    tabelaFiltro *t = novaTabela(f, c.blocos);
+    for (size_t k = 0; k < palavras.size(); k++) t->palavras[k].store(palavras[k], memory_order_relaxed);
+    f.capacidade = c.capacidade;
+    f.chaves = c.chaves;
+    f.atual.store(t, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Constrói um novo pagina.dat a partir de registros já ordenados
+ * @param origem Arquivo de entrada (".csv" para texto, senão binário)
+ * @param saida Arquivo de dados a ser criado (sobrescrito)
+ * @param log Log do arquivo de dados anterior, apagado quando o novo toma o lugar dele
+ * @param tamPagina Tamanho da página em bytes (4096 ou 8192)
+ * @param preenchimento Ocupação desejada das páginas, em porcentagem (50 a 100)
+ * @param registros Capacidade mínima do arquivo em registros
+ * @param limiar Maior valor guardado na própria folha (limiarValido)
+ * @return true se o arquivo foi construído
+ *
+ * Esta função:
+ * 1. Lê os registros uma primeira vez e grava, a partir da página 1, o
+ *    excedente dos valores maiores que o limiar
+ * 2. Lê os registros de novo e monta as folhas em sequência, com os
+ *    ponteiros next/prev já definidos (a folha i aponta para i-1 e i+1),
+ *    e o filtro de Bloom das chaves
+ * 3. Monta os níveis internos de baixo para cima a partir da menor chave
+ *    de cada filho, até restar uma única raiz
+ * 4. Estende o arquivo até a capacidade pedida; as páginas finais ficam
+ *    além da marca alto
+ * 5. Grava o cabeçalho por último, com uma única escrita, sincroniza o
+ *    arquivo e só então o renomeia para saida; depois apaga o log antigo e
+ *    grava o filtro (caminhoFiltro), para que a abertura não precise
+ *    refazê-lo
+ *
+ * As páginas são produzidas na ordem do arquivo e gravadas em blocos de
+ * PAGINAS_POR_ESCRITA páginas, sem nenhum reposicionamento, em um arquivo
+ * temporário (saida + ".tmp"). Uma entrada inválida ou uma carga
+ * interrompida deixam o arquivo anterior e o log dele intactos.
+ *
+ * Complexidade: O(n) registros lidos e O(p) páginas gravadas
+ */
+bool carregarOrdenado(const char *origem, const char *saida, const char *log, int tamPagina, int preenchimento, int registros,
+                      int limiar) {
+    string nome = origem;
+    bool csv = nome.size() >= 4 && nome.compare(nome.size() - 4, 4, ".csv") == 0;
+    ifstream in(origem, csv ? ios::in : ios::binary | ios::in);
+    if (!in.is_open()) {
+        cout << "Erro: nao foi possivel abrir " << origem << "!\n";
+        return false;
+    }
+    string temporario = string(saida) + ".tmp";
+    fstream f(temporario, ios::binary | fstream::in | fstream::out | fstream::trunc);
+    if (!f.is_open()) {
+        cout << "Erro: nao foi possivel criar " << temporario << "!\n";
+        return false;
+    }
+    if (preenchimento < 50) preenchimento = 50;
+    if (preenchimento > 100) preenchimento = 100;
+
+    int area = tamPagina - CAB_FOLHA;
+    int minFolha = minimoFolha(tamPagina, limiar);
+    int maxFilhos = capacidadeInterna(tamPagina) + 1;
+    int minFilhos = capacidadeInterna(tamPagina) / 2 + 1;
+    int alvoFolha = std::max(area / 2, area*preenchimento / 100);
+    int alvoFilhos = std::max(minFilhos, maxFilhos*preenchimento / 100);
+    int alvoCompacta = std::max(minFilhos, (capacidadeCompacta(tamPagina) + 1)*preenchimento / 100);
+
+    // Página 0 reservada para o cabeçalho, gravada por último
+    pagina cab;
+    memset(&cab, 0, tamPagina);
+    gravador g = {&f, tamPagina, 0, vector<char>()};
+    acrescentar(g, cab);
+
+    // Primeira leitura: confere a ordem e grava o excedente dos valores
+    // grandes, guardando a referência de cada um para as folhas
+    vector<referenciaExcedente> refs;
+    int porPagina = valorPorPagina(tamPagina);
+    int quant = 0;
+    tipoChave ultima = 0;
+    dados d;
+    while (lerEntrada(in, csv, d)) {
+        if (quant > 0 && !tracos::menor(ultima, d.chave)) {
+            cout << "Erro: entrada fora de ordem no registro " << quant + 1 << " (chave " << d.chave << ")!\n";
+            f.close();
+            remove(temporario.c_str());
+            return false;
+        }
+        ultima = d.chave;
+        quant++;
+        if ((int)d.nome.size() <= limiar) continue;
+        referenciaExcedente r = { (int)d.nome.size(), g.proxima };
+        refs.push_back(r);
+        for (int k = 0; k*porPagina < (int)d.nome.size(); k++) {
+            pagina p;
+            memset(&p, 0, tamPagina);
+            p.excedente.tipo = PAGINA_EXCEDENTE;
+            p.excedente.quant = std::min(porPagina, (int)d.nome.size() - k*porPagina);
+            p.excedente.next = (k + 1)*porPagina < (int)d.nome.size() ? g.proxima + 1 : -1;
+            p.excedente.prev = k ? g.proxima - 1 : -1;
+            p.excedente.chave = d.chave;
+            memcpy(p.excedente.valor, d.nome.data() + k*porPagina, p.excedente.quant);
+            acrescentar(g, p);
+        }
+    }
+    if (in.bad()) {  // Chave fora de tipoChave, já informada
+        f.close();
+        remove(temporario.c_str());
+        return false;
+    }
+    int primeiraFolha = g.proxima;
+    filtroBloom filtro;
+    iniciarFiltro(filtro, quant);
+
+    // Segunda leitura: folhas. A última folha completa fica retida até se
+    // saber se a folha final precisa ser unida a ela
+    in.clear();
+    in.seekg(0, in.beg);
+    vector<entrada> filhos;     // Menor chave e página de cada folha
+    pagina anterior, atual;
+    bool temAnterior = false;
+    memset(&atual, 0, tamPagina);
+    atual.folha.topo = tamPagina;
+    size_t proximaRef = 0;
+    while (lerEntrada(in, csv, d)) {
+        celula c;
+        c.chave = d.chave;
+        acrescentarFiltro(filtro, d.chave);
+        c.excedente = (int)d.nome.size() > limiar;
+        if (c.excedente) c.carga.assign((char*)&refs[proximaRef++], sizeof(referenciaExcedente));
+        else c.carga = d.nome;
+        if (atual.folha.quant > 0 && ocupacaoFolha(atual, tamPagina) + tamanhoCelula(c) > alvoFolha) {
+            if (temAnterior) acrescentarFolha(g, anterior, false, filhos);
+            anterior = atual;
+            temAnterior = true;
+            memset(&atual, 0, tamPagina);
+            atual.folha.topo = tamPagina;
+        }
+        inserirCelula(atual, tamPagina, atual.folha.quant, c);
+    }
+
+    // Folha final abaixo do mínimo: une à anterior ou divide as duas ao meio
+    if (temAnterior && ocupacaoFolha(atual, tamPagina) < minFolha) {
+        vector<celula> regs;
+        lerCelulas(anterior, 0, anterior.folha.quant, regs);
+        lerCelulas(atual, 0, atual.folha.quant, regs);
+        if (ocupacaoFolha(anterior, tamPagina) + ocupacaoFolha(atual, tamPagina) <= area) {
+            montarFolha(anterior, tamPagina, regs.data(), regs.size());
+            atual = anterior;
+            temAnterior = false;
+        } else {
+            vector<size_t> cortes = dividirCelulas(regs, 2);
+            montarFolha(anterior, tamPagina, regs.data(), cortes[1]);
+            montarFolha(atual, tamPagina, &regs[cortes[1]], regs.size() - cortes[1]);
+        }
+    }
+
+    // Grava as folhas restantes; a última encerra a lista
+    if (temAnterior) acrescentarFolha(g, anterior, false, filhos);
+    acrescentarFolha(g, atual, true, filhos);
+    int ultimaFolha = g.proxima - 1;
+
+    // Níveis internos, de baixo para cima, até restar a raiz
+    int altura = 0;
+    while (filhos.size() > 1) {
+        vector<int> grupos = dividirNivel(filhos, alvoFilhos, maxFilhos, minFilhos, alvoCompacta);
+        vector<entrada> acima;
+        size_t ini = 0;
+        for (size_t k = 0; k < grupos.size(); k++) {
+            // Limites da página: a menor chave do primeiro filho e a do
+            // primeiro filho da página seguinte; sem limite nas pontas
+            tipoChave baixo = k > 0 ? filhos[ini].chave : tracos::minimo();
+            tipoChave alto = k + 1 < grupos.size() ? filhos[ini + grupos[k]].chave : tracos::maximo();
+            pagina no;
+            memset(&no, 0, tamPagina);
+            montarInterna(no, tamPagina, &filhos[ini], grupos[k], baixo, alto);
+            entrada e = {filhos[ini].chave, g.proxima};
+            acima.push_back(e);
+            acrescentar(g, no);
+            ini += grupos[k];
+        }
+        filhos.swap(acima);
+        altura++;
+    }
+    int raiz = filhos[0].filho;
+
+    // Páginas restantes até a capacidade pedida: ficam além da marca alto,
+    // então basta estender o arquivo
+    esvaziar(g);
+    int alto = g.proxima - 1;
+    int tam = std::max(alto, paginasNecessarias(std::max(registros, quant), tamPagina));
+    if (tam > alto) estenderArquivo(f, tam, tamPagina);
+
+    // Cabeçalho gravado por último
+    cab.cabecalho.quant = quant;
+    cab.cabecalho.first = primeiraFolha;
+    cab.cabecalho.last = ultimaFolha;
+    cab.cabecalho.free = -1;
+    cab.cabecalho.tam = tam;
+    cab.cabecalho.raiz = raiz;
+    cab.cabecalho.altura = altura;
+    cab.cabecalho.tamPagina = tamPagina;
+    cab.cabecalho.livres = tam - alto;
+    cab.cabecalho.assinatura = tracos::assinatura;
+    cab.cabecalho.alto = alto;
+    cab.cabecalho.limiar = limiar;
+    cab.cabecalho.frias = 0;
+    f.seekp(0, f.beg);
+    f.write((char*)&cab, sizeof(cab.cabecalho));
+    bool gravado = (bool)f;
+    f.close();
+
+    // O arquivo anterior só é substituído por um arquivo completo e no disco
+    int fd = open(temporario.c_str(), O_RDWR);
+    if (!gravado || fd == -1 || fsync(fd) != 0 || close(fd) != 0 || rename(temporario.c_str(), saida) != 0) {
+        cout << "Erro: nao foi possivel gravar " << saida << "!\n";
+        remove(temporario.c_str());
+        return false;
+    }
+    remove(log);  // Um log antigo não vale para o novo arquivo
+    gravarFiltro(filtro, cab, caminhoFiltro(saida).c_str());
+
+    cout << quant << " registro(s) carregado(s) em " << ultimaFolha - primeiraFolha + 1 << " folha(s), altura " << altura << ".\n";
+    return true;
+}
+
+/**
+ * @brief Imprime toda a estrutura do arquivo
+ * @param arq Arquivo aberto
+ *
+ * Mostra:
+ * - Todos os metadados do cabeçalho
+ * - Todas as páginas (folhas, internas e livres) com seu conteúdo
+ *
+ * Complexidade: O(p) onde p é o número de páginas
+ */
+void imprimirEstrutura(arquivo &arq) {
+    pagina &cab = arq.cab;
+
+    cout << "\n=== ESTRUTURA COMPLETA ==="
+         << "\nCabecalho:"
+         << "\n  Quant: " << cab.cabecalho.quant
+         << "\n  First: " << cab.cabecalho.first
+         << "\n  Last: " << cab.cabecalho.last
+         << "\n  Free: " << cab.cabecalho.free
+         << "\n  Tam: " << cab.cabecalho.tam
+         << "\n  Raiz: " << cab.cabecalho.raiz
+         << "\n  Altura: " << cab.cabecalho.altura
+         << "\n  Tamanho da pagina: " << cab.cabecalho.tamPagina
+         << "\n  Livres: " << cab.cabecalho.livres
+         << "\n  Alto: " << cab.cabecalho.alto
+         << "\n  Limiar: " << cab.cabecalho.limiar
+         << "\n\nPaginas:";
+
+    // Imprime todas as páginas já usadas, uma por uma
+    for (int i = 1; i <= cab.cabecalho.alto; i++) {
+        pagina *l = fixar(arq, i);
+        cout << "\n  Pag " << i << ": ";
+        if (l->folha.tipo == PAGINA_FOLHA) {
+            cout << "Folha, Quant=" << l->folha.quant
+                 << ", Next=" << l->folha.next
+                 << ", Prev=" << l->folha.prev
+                 << ", Livre=" << espacoLivre(*l)
+                 << ", Chaves=[";
+            for (int j = 0; j < l->folha.quant; j++) {
+                cout << (j ? " " : "") << l->folha.chave[j];
+            }
+            cout << "]";
+        } else if (l->interna.tipo == PAGINA_INTERNA) {
+            int tamPagina = cab.cabecalho.tamPagina;
+            cout << "Interna, Quant=" << l->interna.quant << (l->interna.compacta ? ", Compacta" : "")
+                 << ", [" << filhoInterna(*l, tamPagina, 0);
+            for (int j = 1; j <= l->interna.quant; j++) {
+                cout << " |" << separadorInterna(*l, j) << "| " << filhoInterna(*l, tamPagina, j);
+            }
+            cout << "]";
+        } else if (l->excedente.tipo == PAGINA_EXCEDENTE) {
+            cout << "Excedente, Chave=" << l->excedente.chave
+                 << ", Bytes=" << l->excedente.quant
+                 << ", Next=" << l->excedente.next
+                 << ", Prev=" << l->excedente.prev;
+        } else {
+            cout << "[LIVRE], Next=" << l->livre.next;
+        }
+        desafixar(arq, i, false);
+    }
+    if (cab.cabecalho.alto < cab.cabecalho.tam) {
+        cout << "\n  Pag " << cab.cabecalho.alto + 1 << " a " << cab.cabecalho.tam << ": [NUNCA USADAS]";
+    }
+    cout << "\n";
+}
+
+/**
+ * @brief Imprime apenas os registros válidos na ordem da lista
+ * @param arq Arquivo aberto
+ *
+ * Percorre a lista de folhas seguindo os ponteiros next a partir da
+ * primeira folha (first) até a última (last), imprimindo os registros
+ * de cada página em ordem. A lista é lida de um instantâneo: escritas de
+ * outras threads durante o percurso não fazem registros sumirem ou
+ * aparecerem duas vezes, nem esperam a impressão de uma folha.
+ *
+ * Complexidade: O(n) onde n é o número de registros ativos
+ */
+void imprimirLista(arquivo &arq) {
+    instantaneo inst;
+    abrirInstantaneo(arq, inst);
+    pagina &cab = inst.cab;
+
+    cout << "\n=== REGISTROS VALIDOS ==="
+         << "\nCabecalho:"
+         << "\n  Quant: " << cab.cabecalho.quant
+         << "\n  First: " << cab.cabecalho.first
+         << "\n  Last: " << cab.cabecalho.last
+         << "\n  Free: " << cab.cabecalho.free
+         << "\n\nRegistros:";
+
+    if (cab.cabecalho.quant == 0) {
+        cout << "\nLista vazia!\n";
+        fecharInstantaneo(arq, inst);
+        return;
+    }
+
+    // Percorre a lista a partir da primeira folha
+    pagina l;
+    int pos = cab.cabecalho.first;
+    while (pos != -1) {
+        lerInstantaneo(arq, inst, pos, l);
+        cout << "\n  Pag " << pos << " (Next=" << l.folha.next
+             << " | Prev=" << l.folha.prev << "):";
+        for (int i = 0; i < l.folha.quant; i++) {
+            cout << "\n    Chave=" << l.folha.chave[i]
+                 << " | Nome=" << valorInstantaneo(arq, inst, lerCelula(l, i));
+        }
+        pos = (pos == cab.cabecalho.last) ? -1 : l.folha.next;
+    }
+    cout << "\n";
+    fecharInstantaneo(arq, inst);
+}
+
+/**
+ * @brief Imprime a lista de páginas livres
+ * @param arq Arquivo aberto
+ *
+ * Percorre a lista de páginas livres seguindo os ponteiros next
+ * a partir da primeira página livre (free) até o final.
+ *
+ * Complexidade: O(p) onde p é o número de páginas livres
+ */
+void imprimirFree(arquivo &arq) {
+    pagina &cab = arq.cab;
+
+    cout << "\n=== PAGINAS LIVRES ==="
+         << "\nCabecalho:"
+         << "\n  Free: " << cab.cabecalho.free
+         << "\n  Livres: " << cab.cabecalho.livres
+         << "\n  Alto: " << cab.cabecalho.alto
+         << "\n\nPaginas livres:";
+
+    int pos = cab.cabecalho.free;
+    while (pos != -1) {
+        pagina *l = fixar(arq, pos);
+        int proxima = l->livre.next;
+        desafixar(arq, pos, false);
+        cout << "\n  Pag " << pos << " -> Next: " << proxima;
+        pos = proxima;
+    }
+    if (cab.cabecalho.alto < cab.cabecalho.tam) {
+        cout << "\n  Pag " << cab.cabecalho.alto + 1 << " a " << cab.cabecalho.tam << " [NUNCA USADAS]";
+    }
+    cout << "\n";
+}
+
+#define JANELA_BUSCA 16  ///< Chaves comparadas de uma vez no fim da busca na página
+
+/**
+ * @brief Estreita por busca binária o trecho que contém a posição da chave
+ * @param chaves Vetor ordenado
+ * @param ini Início do trecho (atualizado)
+ * @param fim Fim do trecho, exclusivo (atualizado)
+ * @param chave Chave procurada
+ *
+ * Para quando restam no máximo JANELA_BUSCA chaves, que as versões
+ * vetoriais comparam de uma vez.
+ */
+template <class T>
+void estreitarBusca(const T *chaves, int &ini, int &fim, T chave) {
+    while (fim - ini > JANELA_BUSCA) {
+        int meio = (ini + fim) / 2;
+        bool menor = chaves[meio] < chave;  // Escolha sem desvio (cmov)
+        ini = menor ? meio + 1 : ini;
+        fim = menor ? fim : meio;
+    }
+}
+
+/**
+ * @brief Primeira posição com chave >= chave em um vetor ordenado (versão escalar)
+ * @param chaves Vetor ordenado
+ * @param quant Quantidade de chaves
+ * @param chave Chave procurada
+ * @return Índice da primeira chave >= chave (quant se nenhuma)
+ */
+template <class T>
+int procurarEscalar(const T *chaves, int quant, T chave) {
+    int ini = 0, fim = quant;
+    while (ini < fim) {
+        int meio = (ini + fim) / 2;
+        if (chaves[meio] < chave) ini = meio + 1;
+        else fim = meio;
+    }
+    return ini;
+}
+
+// Versões vetoriais: depois de estreitar o trecho, contam as chaves menores
+// que a procurada na janela final. Como o vetor é ordenado, essa contagem é
+// a posição. Elas leem JANELA_BUSCA chaves a partir do início da janela,
+// mesmo além de quant; os excedentes são descartados na máscara (a coluna
+// de chaves da folha é seguida pelos slots, e a de separadores da página
+// interna, pelo espaço livre e pelos filhos no fim da mesma página). As
+// versões de 16 bits comparam as distâncias das páginas internas compactas.
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações AVX2 de 8 chaves
+ */
+__attribute__((target("avx2")))
+int procurarAvx2(const int *chaves, int quant, int chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    __m256i c = _mm256_set1_epi32(chave);
+    unsigned mascara = 0;
+    for (int k = 0; k < JANELA_BUSCA; k += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(chaves + ini + k));
+        mascara |= (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(c, v))) << k;
+    }
+    mascara &= (1u << (fim - ini)) - 1;
+    return ini + __builtin_popcount(mascara);
+}
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações AVX2 de 4 chaves de 64 bits
+ */
+__attribute__((target("avx2")))
+int procurarAvx2(const long long *chaves, int quant, long long chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    __m256i c = _mm256_set1_epi64x(chave);
+    unsigned mascara = 0;
+    for (int k = 0; k < JANELA_BUSCA; k += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(chaves + ini + k));
+        mascara |= (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(c, v))) << k;
+    }
+    mascara &= (1u << (fim - ini)) - 1;
+    return ini + __builtin_popcount(mascara);
+}
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações AVX2 de 16 chaves de 16 bits
+ */
+__attribute__((target("avx2")))
+int procurarAvx2(const short *chaves, int quant, short chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    __m256i c = _mm256_set1_epi16(chave);
+    unsigned long long mascara = 0;
+    for (int k = 0; k < JANELA_BUSCA; k += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(chaves + ini + k));
+        mascara |= (unsigned long long)(unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi16(c, v)) << 2*k;
+    }
+    mascara &= (1ULL << 2*(fim - ini)) - 1;  // Dois bits por chave
+    return ini + __builtin_popcountll(mascara) / 2;
+}
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações SSE2 de 4 chaves
+ */
+__attribute__((target("sse2")))
+int procurarSse2(const int *chaves, int quant, int chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    __m128i c = _mm_set1_epi32(chave);
+    unsigned mascara = 0;
+    for (int k = 0; k < JANELA_BUSCA; k += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(chaves + ini + k));
+        mascara |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(c, v))) << k;
+    }
+    mascara &= (1u << (fim - ini)) - 1;
+    return ini + __builtin_popcount(mascara);
+}
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações SSE2 de 8 chaves de 16 bits
+ */
+__attribute__((target("sse2")))
+int procurarSse2(const short *chaves, int quant, short chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    __m128i c = _mm_set1_epi16(chave);
+    unsigned long long mascara = 0;
+    for (int k = 0; k < JANELA_BUSCA; k += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(chaves + ini + k));
+        mascara |= (unsigned long long)(unsigned)_mm_movemask_epi8(_mm_cmpgt_epi16(c, v)) << 2*k;
+    }
+    mascara &= (1ULL << 2*(fim - ini)) - 1;  // Dois bits por chave
+    return ini + __builtin_popcountll(mascara) / 2;
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações NEON de 4 chaves
+ */
+int procurarNeon(const int *chaves, int quant, int chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    int32x4_t c = vdupq_n_s32(chave);
+    int32x4_t limite = vdupq_n_s32(fim - ini);
+    int32x4_t indice = {0, 1, 2, 3};
+    uint32x4_t conta = vdupq_n_u32(0);
+    for (int k = 0; k < JANELA_BUSCA; k += 4) {
+        uint32x4_t menor = vcltq_s32(vld1q_s32(chaves + ini + k), c);
+        conta = vsubq_u32(conta, vandq_u32(menor, vcltq_s32(indice, limite)));
+        indice = vaddq_s32(indice, vdupq_n_s32(4));
+    }
+    return ini + (int)vaddvq_u32(conta);
+}
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações NEON de 8 chaves de 16 bits
+ */
+int procurarNeon(const short *chaves, int quant, short chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    int16x8_t c = vdupq_n_s16(chave);
+    int16x8_t limite = vdupq_n_s16(fim - ini);
+    int16x8_t indice = {0, 1, 2, 3, 4, 5, 6, 7};
+    uint16x8_t conta = vdupq_n_u16(0);
+    for (int k = 0; k < JANELA_BUSCA; k += 8) {
+        uint16x8_t menor = vcltq_s16(vld1q_s16(chaves + ini + k), c);
+        conta = vsubq_u16(conta, vandq_u16(menor, vcltq_s16(indice, limite)));
+        indice = vaddq_s16(indice, vdupq_n_s16(8));
+    }
+    return ini + (int)vaddvq_u16(conta);
+}
+
+/**
+ * @brief Primeira posição com chave >= chave, com comparações NEON de 2 chaves de 64 bits
+ */
+int procurarNeon(const long long *chaves, int quant, long long chave) {
+    int ini = 0, fim = quant;
+    estreitarBusca(chaves, ini, fim, chave);
+    int64x2_t c = vdupq_n_s64(chave);
+    int64x2_t limite = vdupq_n_s64(fim - ini);
+    int64x2_t indice = {0, 1};
+    uint64x2_t conta = vdupq_n_u64(0);
+    for (int k = 0; k < JANELA_BUSCA; k += 2) {
+        uint64x2_t menor = vcltq_s64(vld1q_s64((const int64_t*)(chaves + ini + k)), c);
+        conta = vsubq_u64(conta, vandq_u64(menor, vcltq_s64(indice, limite)));
+        indice = vaddq_s64(indice, vdupq_n_s64(2));
+    }
+    return ini + (int)vaddvq_u64(conta);
+}
+
+#endif
+
+typedef int (*funcaoBusca)(const tipoChave *chaves, int quant, tipoChave chave);
+typedef int (*funcaoBuscaDelta)(const tipoDelta *chaves, int quant, tipoDelta chave);
+
+/**
+ * @brief Escolhe a busca nas páginas de acordo com o processador em uso
+ * @tparam T Tipo comparado (tipoChave, ou tipoDelta nas páginas compactas)
+ *
+ * A escolha é feita uma vez, ao iniciar o programa, para que o mesmo
+ * executável rode com AVX2 onde existe e com SSE2, NEON ou a versão
+ * escalar nos demais.
+ */
+template <class T>
+auto escolherBusca() -> int (*)(const T*, int, T) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return procurarAvx2;
+    if constexpr (sizeof(T) < 8) {
+        if (__builtin_cpu_supports("sse2")) return procurarSse2;  // SSE2 não compara inteiros de 64 bits
+    }
+#elif defined(__aarch64__)
+    return procurarNeon;
+#endif
+    return procurarEscalar<T>;
+}
+
+funcaoBusca procurarChave = escolherBusca<tipoChave>();       ///< Busca nas páginas escolhida para este processador
+funcaoBuscaDelta procurarDelta = escolherBusca<tipoDelta>();  ///< Busca nas páginas internas compactas
+
+/**
+ * @brief Localiza a posição de uma chave dentro de uma folha
+ * @param l Página folha
+ * @param quant Quantidade de registros considerada
+ * @param chave Chave procurada
+ * @return Índice do primeiro registro com chave >= chave (quant se nenhum)
+ *
+ * A busca percorre apenas a coluna de chaves, com a implementação
+ * escolhida por escolherBusca.
+ *
+ * Complexidade: O(log B) comparações
+ */
+int posicaoRegistro(pagina &l, int quant, tipoChave chave) {
+    return procurarChave(l.folha.chave, quant, chave);
+}
+
+/**
+ * @brief Localiza a posição de uma chave dentro de uma folha
+ * @param l Página folha
+ * @param chave Chave procurada
+ * @return Índice do primeiro registro com chave >= chave (quant se nenhum)
+ */
+int posicaoRegistro(pagina &l, tipoChave chave) {
+    return posicaoRegistro(l, l.folha.quant, chave);
+}
+
+/**
+ * @brief Escolhe o filho de uma página interna que pode conter a chave
+ * @param no Página interna
+ * @param quant Quantidade de separadores considerada
+ * @param compacta Formato da página considerado
+ * @param chave Chave procurada
+ * @return Índice do filho (quantidade de separadores <= chave)
+ *
+ * A quantidade e o formato vêm à parte para a leitura otimista, que os lê
+ * uma única vez e confere os limites antes da busca. Os separadores
+ * formam uma coluna própria, então a busca é a mesma da folha; como não
+ * se repetem, basta contar um separador igual à chave. Na página
+ * compacta a chave é convertida na distância até a base e a busca é
+ * feita direto nas distâncias, sem decodificar a página: uma chave abaixo
+ * da base ou além do alcance fica antes ou depois de todos os separadores.
+ *
+ * Complexidade: O(log B) comparações
+ */
+int posicaoFilho(pagina &no, int quant, int compacta, tipoChave chave) {
+    if (compacta) {
+        tipoChave base = no.interna.chave[0];
+        if (tracos::menor(chave, base)) return 0;
+        if (tracos::distancia(base, chave) > ALCANCE_DELTA) return quant;
+        tipoDelta d = codificarDelta(chave, base);
+        const tipoDelta *deltas = deltasInterna(no);
+        int i = procurarDelta(deltas + 1, quant, d);
+        if (i < quant && deltas[i + 1] == d) i++;
+        return i;
+    }
+    int i = procurarChave(no.interna.chave + 1, quant, chave);
+    if (i < quant && no.interna.chave[i + 1] == chave) i++;
+    return i;
+}
+
+/**
+ * @brief Escolhe o filho de uma página interna que pode conter a chave
+ * @param no Página interna
+ * @param chave Chave procurada
+ * @return Índice do filho (quantidade de separadores <= chave)
+ */
+int posicaoFilho(pagina &no, tipoChave chave) {
+    return posicaoFilho(no, no.interna.quant, no.interna.compacta, chave);
+}
+
+#define DESCIDA_COMPLETA 0  ///< Guarda o caminho inteiro
+#define DESCIDA_INSERCAO 1  ///< Solta os ancestrais de páginas que não vão se dividir
+#define DESCIDA_REMOCAO 2   ///< Solta os ancestrais de páginas que não vão se fundir
+
+/**
+ * @brief Diz se uma página absorve a operação sem alterar o pai
+ * @param arq Arquivo aberto
+ * @param p Página visitada na descida
+ * @param raiz Se true, p é a raiz
+ * @param modo DESCIDA_COMPLETA, DESCIDA_INSERCAO ou DESCIDA_REMOCAO
+ *
+ * Na inserção, uma página com espaço livre não se divide; na remoção,
+ * uma página acima da ocupação mínima não se funde (a raiz só deixa de
+ * existir quando perde a última chave). Na folha, as duas contas supõem
+ * um registro do maior tamanho possível (registroMaximo).
+ */
+bool paginaSegura(arquivo &arq, pagina &p, bool raiz, int modo) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    if (modo == DESCIDA_COMPLETA) return false;
+    if (p.folha.tipo == PAGINA_FOLHA) {
+        int rmax = registroMaximo(arq.cab.cabecalho.limiar);
+        if (modo == DESCIDA_INSERCAO) return espacoLivre(p) >= rmax;
+        return raiz || ocupacaoFolha(p, tamPagina) - rmax >= minimoFolha(tamPagina, arq.cab.cabecalho.limiar);
+    }
+    if (modo == DESCIDA_INSERCAO) return p.interna.quant < capacidadePagina(p, tamPagina);
+    return p.interna.quant > (raiz ? 1 : capacidadeInterna(tamPagina) / 2);
+}
+
+/**
+ * @brief Desce da raiz até a folha que pode conter a chave, para alterá-la
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ * @param chave Chave procurada
+ * @param c Caminho percorrido (preenchido pela função; liberar com soltarCaminho)
+ * @param modo DESCIDA_COMPLETA, DESCIDA_INSERCAO ou DESCIDA_REMOCAO
+ * @return Número da página folha, fixada em c.folha (desafixar à parte)
+ *
+ * As páginas são travadas de forma exclusiva de cima para baixo. Ao
+ * chegar a uma página segura para a operação (paginaSegura), os
+ * ancestrais já travados são soltos, pois nenhuma divisão ou fusão vai
+ * subir além dela: o caminho guardado começa nessa página e c.raiz indica
+ * se ele ainda começa na raiz (com mRaiz travada). Uma descida feita
+ * enquanto outro caminho da mesma thread está preso reaproveita as travas
+ * que ela já tem. Os limites das chaves abaixo de cada página (os
+ * separadores dos ancestrais) são anotados antes de os ancestrais serem
+ * soltos, para a escolha do formato das páginas criadas ou alteradas.
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+int descer(arquivo &arq, tipoChave chave, caminho &c, int modo = DESCIDA_COMPLETA) {
+    if (minhaThread.raiz++ == 0) arq.mRaiz.lock();
+    c.raiz = true;
+    c.altura = 0;
+    int pos = arq.cab.cabecalho.raiz;
+    int altura = arq.cab.cabecalho.altura;
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    tipoChave baixo = tracos::minimo(), alto = tracos::maximo();
+    for (int nivel = 0; nivel < altura; nivel++) {
+        pagina *no = fixar(arq, pos);
+        if (paginaSegura(arq, *no, nivel == 0, modo)) soltarCaminho(arq, c);
+        int i = posicaoFilho(*no, chave);
+        c.pos[c.altura] = pos;
+        c.no[c.altura] = no;
+        c.ind[c.altura] = i;
+        c.baixo[c.altura] = baixo;
+        c.alto[c.altura] = alto;
+        if (i > 0) baixo = separadorInterna(*no, i);
+        if (i < no->interna.quant) alto = separadorInterna(*no, i + 1);
+        pos = filhoInterna(*no, tamPagina, i);
+        c.altura++;
+    }
+    c.folha = fixar(arq, pos);
+    if (paginaSegura(arq, *c.folha, altura == 0, modo)) soltarCaminho(arq, c);
+    CONTAR(CONT_DESCIDAS, 1);
+    CONTAR(CONT_NIVEIS, altura + 1);
+    return pos;
+}
+
+/**
+ * @brief Desce da raiz até a folha sem guardar o caminho
+ * @param arq Arquivo aberto
+ * @param chave Chave procurada
+ * @param pos Recebe o número da página folha
+ * @return A folha, fixada (desafixar depois do uso)
+ *
+ * Acoplamento de travas: cada filho é fixado antes de o pai ser
+ * desafixado, então uma divisão ou fusão feita por outra thread nunca é
+ * vista pela metade.
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+pagina *buscarFolha(arquivo &arq, tipoChave chave, int &pos) {
+    arq.mRaiz.lock_shared();
+    pos = arq.cab.cabecalho.raiz;
+    int altura = arq.cab.cabecalho.altura;
+    pagina *no = fixar(arq, pos);
+    arq.mRaiz.unlock_shared();
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    for (int nivel = 0; nivel < altura; nivel++) {
+        int filho = filhoInterna(*no, tamPagina, posicaoFilho(*no, chave));
+        pagina *abaixo = fixar(arq, filho);
+        desafixar(arq, pos, false);
+        pos = filho;
+        no = abaixo;
+    }
+    return no;
+}
+
+/**
+ * @brief Lê um campo de página que pode estar sendo alterado por outra thread
+ * @param x Campo da página
+ *
+ * Usada pela leitura otimista nos campos que decidem limites e ponteiros
+ * (tipo, quant, filho): o valor é lido uma única vez, sem ser recarregado
+ * pelo compilador no meio do uso.
+ */
+int lerCampo(const int &x) {
+    return __atomic_load_n(&x, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Publica raiz e altura do cabeçalho para a leitura otimista
+ * @param arq Arquivo aberto (com mRaiz travada, se há outras threads)
+ */
+void publicarRaiz(arquivo &arq) {
+    long long ra = ((long long)arq.cab.cabecalho.raiz << 32) | arq.cab.cabecalho.altura;
+    arq.raizAltura.store(ra, memory_order_release);
+}
+
+/**
+ * @brief Desce da raiz até a folha sem fixar nem travar páginas
+ * @param arq Arquivo aberto (buffer pool)
+ * @param chave Chave procurada
+ * @param pos Recebe o número da página folha
+ * @param versao Recebe a versão do quadro da folha
+ * @return Quadro da folha, ou -1 se a descida precisa ser refeita
+ *
+ * Em cada nível a versão do filho é anotada antes de o pai ser validado:
+ * se o pai não mudou até ali, o filho escolhido era o certo naquele
+ * instante, e qualquer alteração posterior do filho muda a sua versão. A
+ * folha devolvida ainda precisa ser validada por quem a lê. Falha se
+ * alguma página não estiver no cache ou estiver sendo alterada.
+ *
+ * Complexidade: O(log_B n) páginas lidas, nenhuma escrita em memória compartilhada
+ */
+int descerOtimista(arquivo &arq, tipoChave chave, int &pos, unsigned long long &versao) {
+    long long ra = arq.raizAltura.load(memory_order_acquire);
+    pos = (int)(ra >> 32);
+    int altura = (int)(ra & 0xffffffff);
+    int i = iniciarLeitura(arq, pos, versao);
+    if (i == -1 || arq.raizAltura.load(memory_order_relaxed) != ra) return -1;
+
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    for (int nivel = 0; nivel < altura; nivel++) {
+        pagina &no = arq.memoria[i];
+        int quant = lerCampo(no.interna.quant);
+        int compacta = lerCampo(no.interna.compacta) != 0;
+        if (lerCampo(no.interna.tipo) != PAGINA_INTERNA || quant < 0 || quant > capacidadePagina(compacta, tamPagina)) return -1;
+        int filho = lerCampo(filhoInterna(no, tamPagina, posicaoFilho(no, quant, compacta, chave)));
+
+        unsigned long long versaoFilho;
+        int j = iniciarLeitura(arq, filho, versaoFilho);
+        if (j == -1 || !validarLeitura(arq, i, versao)) return -1;
+        i = j;
+        versao = versaoFilho;
+        pos = filho;
+    }
+    CONTAR(CONT_DESCIDAS, 1);
+    CONTAR(CONT_NIVEIS, altura + 1);
+    return i;
+}
+
+/**
+ * @brief Insere um par (separador, filho) no índice
+ * @param arq Arquivo aberto
+ * @param c Caminho da descida até a folha dividida
+ * @param chave Chave separadora (menor chave do novo filho)
+ * @param filho Página do novo filho, à direita do filho seguido na descida
+ *
+ * Se a página estiver cheia ela é dividida ao meio e a chave do meio sobe
+ * para o pai, repetindo o processo até a raiz. Quando a raiz se divide, uma
+ * nova raiz é criada e a altura aumenta. Um caminho que não começa na raiz
+ * (descer com DESCIDA_INSERCAO) termina em uma página com espaço, então a
+ * divisão nunca passa dela. O separador novo está entre os limites da
+ * página, então sempre cabe no formato dela; as duas metades de uma
+ * divisão recebem o formato dos seus novos limites (montarInterna).
+ */
+void inserirSeparador(arquivo &arq, caminho &c, tipoChave chave, int filho) {
+    pagina &cab = arq.cab;
+    int tamPagina = cab.cabecalho.tamPagina;
+    int nivel = c.altura - 1;
+
+    while (nivel >= 0) {
+        pagina &no = *c.no[nivel];
+        int i = c.ind[nivel] + 1;  // Posição do novo item
+        int max = capacidadePagina(no, tamPagina);
+
+        // Cabe na página: desloca os itens à direita de i
+        if (no.interna.quant < max) {
+            moverEntradas(no, i + 1, no, i, no.interna.quant + 1 - i, tamPagina);
+            escreverSeparador(no, i, chave);
+            filhoInterna(no, tamPagina, i) = filho;
+            no.interna.quant++;
+            marcarSuja(arq, c.pos[nivel]);
+            return;
+        }
+
+        // Página cheia: monta a sequência com o novo item e divide ao meio
+        vector<entrada> itens;
+        for (int k = 0; k <= max; k++) itens.push_back(entradaInterna(no, tamPagina, k));
+        entrada novo = {chave, filho};
+        itens.insert(itens.begin() + i, novo);
+
+        int total = max + 1;            // Chaves após a inserção
+        int meio = (total + 1) / 2;     // Chave que sobe para o pai
+        int posDireita = alocarPagina(arq, c.pos[nivel] + 1);
+        pagina *direita = fixar(arq, posDireita, true);
+        montarInterna(*direita, tamPagina, &itens[meio], total + 1 - meio, itens[meio].chave, c.alto[nivel]);
+        montarInterna(no, tamPagina, itens.data(), meio, c.baixo[nivel], itens[meio].chave);
+        marcarSuja(arq, c.pos[nivel]);
+        desafixar(arq, posDireita, true);
+
+        // A chave do meio sobe para o pai
+        chave = itens[meio].chave;
+        filho = posDireita;
+        nivel--;
+    }
+
+    // A raiz foi dividida: cria uma nova raiz
+    int posRaiz = alocarPagina(arq);
+    pagina *raiz = fixar(arq, posRaiz, true);
+    entrada itens[2] = {{0, cab.cabecalho.raiz}, {chave, filho}};
+    montarInterna(*raiz, tamPagina, itens, 2, tracos::minimo(), tracos::maximo());
+    desafixar(arq, posRaiz, true);
+    cab.cabecalho.raiz = posRaiz;
+    cab.cabecalho.altura++;
+    arq.cabSujo = true;
+    publicarRaiz(arq);
+}
+
+/**
+ * @brief Corrige páginas internas abaixo da ocupação mínima após uma fusão
+ * @param arq Arquivo aberto
+ * @param c Caminho da descida (as páginas em memória já refletem a fusão)
+ * @param nivel Nível da página que perdeu um filho
+ *
+ * Uma página com menos da metade das chaves pega emprestado um filho de
+ * uma irmã ou se funde com ela, o que pode se propagar até a raiz. Uma
+ * raiz interna sem chaves é substituída pelo seu único filho. A página
+ * que recebe separadores de fora dos seus limites é antes regravada no
+ * formato dos novos limites (relimitarInterna); a ocupação mínima é a da
+ * página não compacta, então o resultado sempre cabe em qualquer formato.
+ */
+void ajustarIndice(arquivo &arq, caminho &c, int nivel) {
+    pagina &cab = arq.cab;
+    int tamPagina = cab.cabecalho.tamPagina;
+    int max = capacidadeInterna(tamPagina);
+    int minimo = max / 2;
+
+    while (nivel > 0) {
+        pagina &no = *c.no[nivel];
+        marcarSuja(arq, c.pos[nivel]);
+        if (no.interna.quant >= minimo) return;
+
+        pagina &pai = *c.no[nivel - 1];
+        int j = c.ind[nivel - 1];
+        int remover;  // Item do pai que deixa de existir após a fusão
+        marcarSuja(arq, c.pos[nivel - 1]);
+
+        if (j > 0) {
+            int posIrma = filhoInterna(pai, tamPagina, j - 1);
+            pagina &irma = *fixar(arq, posIrma);
+
+            // Empréstimo da irmã esquerda: seu último filho passa a ser o primeiro
+            if (irma.interna.quant > minimo) {
+                tipoChave subir = separadorInterna(irma, irma.interna.quant);
+                relimitarInterna(no, tamPagina, subir, c.alto[nivel]);
+                moverEntradas(no, 1, no, 0, no.interna.quant + 1, tamPagina);
+                escreverSeparador(no, 1, separadorInterna(pai, j));
+                filhoInterna(no, tamPagina, 0) = filhoInterna(irma, tamPagina, irma.interna.quant);
+                no.interna.quant++;
+                escreverSeparador(pai, j, subir);
+                irma.interna.quant--;
+                desafixar(arq, posIrma, true);
+                return;
+            }
+
+            // Fusão com a irmã esquerda: a página atual é absorvida
+            int q = irma.interna.quant;
+            relimitarInterna(irma, tamPagina, j > 1 ? separadorInterna(pai, j - 1) : c.baixo[nivel - 1], c.alto[nivel]);
+            escreverSeparador(irma, q + 1, separadorInterna(pai, j));
+            filhoInterna(irma, tamPagina, q + 1) = filhoInterna(no, tamPagina, 0);
+            moverEntradas(irma, q + 2, no, 1, no.interna.quant, tamPagina);
+            irma.interna.quant += no.interna.quant + 1;
+            desafixar(arq, posIrma, true);
+            liberarPagina(arq, c.pos[nivel]);
+            remover = j;
+        } else {
+            int posIrma = filhoInterna(pai, tamPagina, j + 1);
+            pagina &irma = *fixar(arq, posIrma);
+
+            // Empréstimo da irmã direita: seu primeiro filho passa a ser o último
+            if (irma.interna.quant > minimo) {
+                tipoChave subir = separadorInterna(irma, 1);
+                relimitarInterna(no, tamPagina, c.baixo[nivel], subir);
+                int q = no.interna.quant;
+                escreverSeparador(no, q + 1, separadorInterna(pai, j + 1));
+                filhoInterna(no, tamPagina, q + 1) = filhoInterna(irma, tamPagina, 0);
+                no.interna.quant++;
+                escreverSeparador(pai, j + 1, subir);
+                filhoInterna(irma, tamPagina, 0) = filhoInterna(irma, tamPagina, 1);
+                moverEntradas(irma, 1, irma, 2, irma.interna.quant - 1, tamPagina);
+                irma.interna.quant--;
+                desafixar(arq, posIrma, true);
+                return;
+            }
+
+            // Fusão com a irmã direita: a irmã é absorvida
+            int q = no.interna.quant;
+            relimitarInterna(no, tamPagina, c.baixo[nivel], j + 1 < pai.interna.quant ? separadorInterna(pai, j + 2) : c.alto[nivel - 1]);
+            escreverSeparador(no, q + 1, separadorInterna(pai, j + 1));
+            filhoInterna(no, tamPagina, q + 1) = filhoInterna(irma, tamPagina, 0);
+            moverEntradas(no, q + 2, irma, 1, irma.interna.quant, tamPagina);
+            no.interna.quant += irma.interna.quant + 1;
+            desafixar(arq, posIrma, false);
+            liberarPagina(arq, posIrma);
+            remover = j + 1;
+        }
+
+        // O pai perde o item da página absorvida
+        moverEntradas(pai, remover, pai, remover + 1, pai.interna.quant - remover, tamPagina);
+        pai.interna.quant--;
+        nivel--;
+    }
+
+    // Raiz interna sem chaves: o único filho vira a nova raiz
+    marcarSuja(arq, c.pos[0]);
+    if (c.raiz && c.no[0]->interna.quant == 0) {
+        cab.cabecalho.raiz = filhoInterna(*c.no[0], tamPagina, 0);
+        cab.cabecalho.altura--;
+        arq.cabSujo = true;
+        publicarRaiz(arq);
+        liberarPagina(arq, c.pos[0]);
+    }
+}
+
+/**
+ * @brief Imprime as páginas internas do índice, nível a nível
+ * @param arq Arquivo aberto
+ *
+ * Complexidade: O(m) onde m é o número de páginas internas
+ */
+void imprimirIndice(arquivo &arq) {
+    pagina &cab = arq.cab;
+
+    cout << "\n=== INDICE ==="
+         << "\nCabecalho:"
+         << "\n  Raiz: " << cab.cabecalho.raiz
+         << "\n  Altura: " << cab.cabecalho.altura;
+
+    int tamPagina = cab.cabecalho.tamPagina;
+    vector<int> nivel(1, cab.cabecalho.raiz);
+    for (int n = 0; n < cab.cabecalho.altura; n++) {
+        cout << "\n\nNivel " << n << (n == cab.cabecalho.altura - 1 ? " (filhos sao folhas):" : ":");
+        vector<int> abaixo;
+        for (size_t k = 0; k < nivel.size(); k++) {
+            pagina *no = fixar(arq, nivel[k]);
+            cout << "\n  Pag " << nivel[k] << (no->interna.compacta ? " (compacta)" : "") << ": [" << filhoInterna(*no, tamPagina, 0);
+            for (int i = 1; i <= no->interna.quant; i++) {
+                cout << " |" << separadorInterna(*no, i) << "| " << filhoInterna(*no, tamPagina, i);
+            }
+            cout << "]";
+            for (int i = 0; i <= no->interna.quant; i++) abaixo.push_back(filhoInterna(*no, tamPagina, i));
+            desafixar(arq, nivel[k], false);
+        }
+        nivel.swap(abaixo);
+    }
+    cout << "\n";
+}
+
+/**
+ * @struct referencia
+ * @brief Localização de um registro, devolvida pela pesquisa ou pela inserção
+ *
+ * Vale enquanto a folha não for alterada por uma divisão, fusão ou
+ * redistribuição; removerReferencia confere isso antes de usá-la.
+ */
+struct referencia {
+    int folha;  ///< Página folha do registro
+    int i;      ///< Índice do registro na folha
+    tipoChave chave;  ///< Chave do registro
+};
+
+bool remover(arquivo &arq, tipoChave chave);
+
+/**
+ * @brief Insere um registro ou, opcionalmente, substitui o existente
+ * @param arq Arquivo aberto
+ * @param d Dados a serem gravados
+ * @param substituir Se true, uma chave existente tem o nome substituído
+ * @param ref Se não for NULL, recebe a localização do registro gravado
+ * @return 1 se inseriu, 0 se substituiu, -1 se nada foi gravado
+ *
+ * Esta função:
+ * 1. Desce pelo índice até a folha que deve conter a chave
+ * 2. Uma única busca binária na folha encontra ao mesmo tempo a chave
+ *    repetida e a posição de inserção
+ * 3. Grava o excedente, se o nome passa do limiar, e insere o registro na
+ *    folha, deslocando as chaves e os slots dos maiores
+ * 4. Se o registro não cabe na folha, divide os bytes da folha ao meio,
+ *    encadeia a nova folha entre as vizinhas e insere o separador no
+ *    índice; sem páginas livres suficientes, o arquivo cresce antes
+ *    (crescerArquivo)
+ * 5. Atualiza o cabeçalho
+ *
+ * A substituição troca o registro na própria folha; se o novo nome não
+ * cabe nela ou a deixa abaixo da ocupação mínima, o registro é removido e
+ * inserido de novo, na mesma operação.
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+int gravarRegistro(arquivo &arq, dados d, bool substituir, referencia *ref = NULL) {
+    ESTATISTICA(arq, ESTAT_INSERCAO);
+    pagina &cab = arq.cab;
+    caminho c;
+    if (d.nome.size() > VALOR_MAX) {
+        cout << "Erro: Nome com mais de " << VALOR_MAX << " bytes!\n";
+        return -1;
+    }
+
+    // Localiza a folha e a posição da chave
+    iniciarEscrita(arq);
+    acrescentarFiltro(arq.filtro, d.chave);
+    int folha = descer(arq, d.chave, c, DESCIDA_INSERCAO);
+    pagina &l = *c.folha;
+    int i = posicaoRegistro(l, d.chave);
+    int tamPagina = cab.cabecalho.tamPagina;
+    int excedente = paginasValor(arq, d.nome.size());
+    int tam = tamanhoRegistro(excedente ? sizeof(referenciaExcedente) : d.nome.size());
+
+    // Chave já existe: substitui o registro na própria folha ou recusa
+    if (i < l.folha.quant && l.folha.chave[i] == d.chave) {
+        soltarCaminho(arq, c);
+        if (!substituir) {
+            cout << "Erro: Chave ja existente!\n";
+            desafixar(arq, folha, false);
+            return -1;
+        }
+        celula antiga = lerCelula(l, i);
+        int livre = espacoLivre(l) + tamanhoCelula(antiga);
+        bool raiz = folha == cab.cabecalho.raiz;
+        if (livre >= tam && (raiz || tamPagina - CAB_FOLHA - livre + tam >= minimoFolha(tamPagina, cab.cabecalho.limiar)) &&
+            cab.cabecalho.livres >= excedente) {
+            celula nova = prepararCelula(arq, d, folha);
+            removerCelulas(l, i, 1);
+            inserirCelula(l, tamPagina, i, nova);
+            liberarCelula(arq, antiga);
+            if (ref) *ref = referencia{folha, i, d.chave};
+            desafixar(arq, folha, true);
+            return 0;
+        }
+        desafixar(arq, folha, false);
+        if (cab.cabecalho.livres < excedente + cab.cabecalho.altura + 2 &&
+            !crescerArquivo(arq, excedente + cab.cabecalho.altura + 2)) {
+            cout << "Erro: Arquivo cheio!\n";
+            return -1;
+        }
+        remover(arq, d.chave);
+        return gravarRegistro(arq, d, false, ref) == 1 ? 0 : -1;
+    }
+
+    // Cabe na folha: apenas desloca as chaves e os slots dos maiores
+    if (espacoLivre(l) >= tam) {
+        if (cab.cabecalho.livres < excedente) {
+            desafixar(arq, folha, false);
+            soltarCaminho(arq, c);
+            if (crescerArquivo(arq, excedente)) return gravarRegistro(arq, d, substituir, ref);
+            cout << "Erro: Arquivo cheio!\n";
+            return -1;
+        }
+        inserirCelula(l, tamPagina, i, prepararCelula(arq, d, folha));
+        if (ref) *ref = referencia{folha, i, d.chave};
+        desafixar(arq, folha, true);
+        soltarCaminho(arq, c);
+
+        cab.cabecalho.quant++;
+        arq.cabSujo = true;
+        return 1;
+    }
+
+    // Folha cheia: a divisão pode se propagar e precisa de uma página por
+    // nível cheio, mais uma se a raiz também se dividir, além do excedente
+    int necessarias = 1;
+    for (int nivel = c.altura - 1; nivel >= 0 && c.no[nivel]->interna.quant == capacidadePagina(*c.no[nivel], tamPagina); nivel--) {
+        necessarias++;
+    }
+    if (c.raiz && necessarias == c.altura + 1) necessarias++;
+    necessarias += excedente;
+
+    // Sem espaço livre: aumenta o arquivo e refaz a inserção
+    if (cab.cabecalho.livres < necessarias) {
+        desafixar(arq, folha, false);
+        soltarCaminho(arq, c);
+        if (crescerArquivo(arq, necessarias)) return gravarRegistro(arq, d, substituir, ref);
+        cout << "Erro: Arquivo cheio!\n";
+        return -1;
+    }
+
+    // Monta a sequência com o novo registro e divide os bytes ao meio
+    vector<celula> regs;
+    lerCelulas(l, 0, l.folha.quant, regs);
+    regs.insert(regs.begin() + i, prepararCelula(arq, d, folha));
+    int esquerda = dividirCelulas(regs, 2)[1];
+
+    int posNova = alocarPagina(arq, folha + 1);
+    pagina &nova = *fixar(arq, posNova, true);
+    nova.folha.tipo = PAGINA_FOLHA;
+    montarFolha(nova, tamPagina, &regs[esquerda], regs.size() - esquerda);
+    montarFolha(l, tamPagina, regs.data(), esquerda);
+    if (ref) *ref = (i < esquerda) ? referencia{folha, i, d.chave} : referencia{posNova, i - esquerda, d.chave};
+
+    // Encadeia a nova folha logo após a folha dividida
+    nova.folha.prev = folha;
+    nova.folha.next = l.folha.next;
+    if (l.folha.next != -1) {
+        pagina *proxima = fixar(arq, l.folha.next);
+        proxima->folha.prev = posNova;
+        desafixar(arq, l.folha.next, true);
+    } else {
+        cab.cabecalho.last = posNova;
+    }
+    l.folha.next = posNova;
+
+    // Insere o separador no índice
+    tipoChave separador = nova.folha.chave[0];
+    desafixar(arq, folha, true);
+    desafixar(arq, posNova, true);
+    inserirSeparador(arq, c, separador, posNova);
+    soltarCaminho(arq, c);
+
+    // Atualiza cabeçalho
+    cab.cabecalho.quant++;
+    arq.cabSujo = true;
+    return 1;
+}
+
+/**
+ * @brief Insere um novo registro mantendo a ordenação por chave
+ * @param arq Arquivo aberto
+ * @param d Dados a serem inseridos
+ *
+ * Uma chave já existente é recusada com mensagem de erro.
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+void inserirOrdenado(arquivo &arq, dados d) {
+    gravarRegistro(arq, d, false);
+}
+
+/**
+ * @brief Insere um registro ou substitui o nome de uma chave existente
+ * @param arq Arquivo aberto
+ * @param d Dados a serem gravados
+ * @return true se a chave já existia e o nome foi substituído
+ *
+ * Faz uma única descida e uma única busca na folha, em vez de uma
+ * pesquisa seguida de remoção e inserção.
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+bool inserirOuSubstituir(arquivo &arq, dados d) {
+    return gravarRegistro(arq, d, true) == 0;
+}
+
+/**
+ * @brief Compara dois registros pela chave (ordenação de lotes)
+ */
+bool menorChave(const dados &a, const dados &b) {
+    return tracos::menor(a.chave, b.chave);
+}
+
+/**
+ * @brief Maior chave (exclusiva) que pode ir para a folha alcançada por descer
+ * @param c Caminho da descida
+ * @param limite Recebe o separador à direita da folha, se existir
+ * @return false se a folha é a última da árvore (sem limite superior)
+ */
+bool limiteFolha(caminho &c, tipoChave &limite) {
+    for (int nivel = c.altura - 1; nivel >= 0; nivel--) {
+        if (c.ind[nivel] < c.no[nivel]->interna.quant) {
+            limite = separadorInterna(*c.no[nivel], c.ind[nivel] + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Insere um lote de registros de uma só vez
+ * @param arq Arquivo aberto
+ * @param lote Registros a inserir, em qualquer ordem
+ * @return Quantidade de registros inseridos
+ *
+ * Esta função:
+ * 1. Ordena o lote pela chave uma única vez
+ * 2. Para cada folha atingida, desce pelo índice apenas uma vez e separa a
+ *    sequência de registros do lote que pertence a ela
+ * 3. Intercala essa sequência com os registros da folha, descartando chaves
+ *    repetidas (no lote ou já existentes)
+ * 4. Se o resultado não couber, distribui os registros por novas folhas
+ *    encadeadas em sequência, com as páginas retiradas da lista de livres
+ *    de uma vez, e insere um separador por folha nova
+ * 5. Atualiza o cabeçalho, residente em memória, gravado uma única vez
+ *    quando o cache é descarregado
+ *
+ * Quando restam poucas páginas livres para a divisão, o arquivo cresce
+ * antes de a folha ser refeita; se não puder crescer, a sequência daquela
+ * folha é inserida registro a registro por inserirOrdenado.
+ *
+ * Complexidade: O(k log k) para ordenar, mais O(log_B n) páginas lidas por
+ * folha atingida, em vez de por registro
+ */
+int inserirLote(arquivo &arq, vector<dados> lote) {
+    ESTATISTICA(arq, ESTAT_LOTE);
+    pagina &cab = arq.cab;
+    int tamPagina = cab.cabecalho.tamPagina;
+    int area = tamPagina - CAB_FOLHA;
+    int rmax = registroMaximo(cab.cabecalho.limiar);
+    int inseridos = 0;
+
+    iniciarEscrita(arq);
+    stable_sort(lote.begin(), lote.end(), menorChave);
+    // Na alocação por endereço, cada página nova altera também a anterior
+    // a ela na lista de livres: o grupo fica com a metade das folhas
+    int parte = arq.alocacao == ALOCACAO_ENDERECO ? 8 : 4;
+    int orcamento = std::max(1, (int)arq.quadros.size() / parte);
+
+    size_t i = 0;
+    while (i < lote.size()) {
+        caminho c;
+        int folha = descer(arq, lote[i].chave, c);
+
+        // Registros do lote que pertencem a esta folha, no máximo o que
+        // ocupa um quarto do cache (folhas e excedente); o restante vai na
+        // próxima volta
+        tipoChave limite;
+        bool limitado = limiteFolha(c, limite);
+        size_t fim = i;
+        long long bytes = 0;
+        int excedente = 0;
+        while (fim < lote.size() && (!limitado || lote[fim].chave < limite)) {
+            int n = paginasValor(arq, lote[fim].nome.size());
+            if (fim > i && bytes / area + excedente + n >= orcamento) break;
+            bytes += tamanhoRegistro(n ? sizeof(referenciaExcedente) : lote[fim].nome.size());
+            excedente += n;
+            fim++;
+        }
+        // Só a sequência desta volta: uma confirmação entre duas voltas pode
+        // refazer o filtro a partir das folhas (terminarEscrita)
+        for (size_t j = i; j < fim; j++) acrescentarFiltro(arq.filtro, lote[j].chave);
+
+        // Intercala a sequência com os registros da folha; os valores
+        // grandes entram com uma referência provisória, do mesmo tamanho,
+        // e origem guarda de que registro do lote veio cada célula nova
+        pagina *l = c.folha;
+        vector<celula> regs;
+        vector<int> origem;
+        regs.reserve(l->folha.quant + (fim - i));
+        int a = 0;
+        excedente = 0;
+        for (size_t j = i; j < fim; j++) {
+            if (j > i && lote[j].chave == lote[j - 1].chave) continue;  // Repetida no lote
+            if (lote[j].nome.size() > VALOR_MAX) {
+                cout << "Erro: Nome com mais de " << VALOR_MAX << " bytes!\n";
+                continue;
+            }
+            while (a < l->folha.quant && l->folha.chave[a] < lote[j].chave) {
+                regs.push_back(lerCelula(*l, a++));
+                origem.push_back(-1);
+            }
+            if (a < l->folha.quant && l->folha.chave[a] == lote[j].chave) continue;  // Já existente
+            int n = paginasValor(arq, lote[j].nome.size());
+            celula nova;
+            nova.chave = lote[j].chave;
+            nova.excedente = n > 0;
+            nova.carga = n ? string(sizeof(referenciaExcedente), 0) : lote[j].nome;
+            regs.push_back(nova);
+            origem.push_back(j);
+            excedente += n;
+        }
+        for (; a < l->folha.quant; a++) {
+            regs.push_back(lerCelula(*l, a));
+            origem.push_back(-1);
+        }
+
+        // Folhas preenchidas até um registro máximo do fim, para que o corte
+        // entre registros nunca passe da página
+        long long total = 0;
+        for (size_t k = 0; k < regs.size(); k++) total += tamanhoCelula(regs[k]);
+        int partes = total <= area ? 1 : (total + area - rmax - 1) / (area - rmax);
+        vector<size_t> cortes = dividirCelulas(regs, partes);
+        int folhas = cortes.size() - 1;
+        int novos = regs.size() - l->folha.quant;
+
+        // Poucas páginas livres para a divisão e o excedente: aumenta o
+        // arquivo e refaz a folha; se não for possível, insere um a um
+        int necessarias = (folhas - 1)*(c.altura + 3) + excedente;
+        if (cab.cabecalho.livres < necessarias) {
+            desafixar(arq, folha, false);
+            soltarCaminho(arq, c);
+            if (crescerArquivo(arq, necessarias)) continue;
+            for (size_t j = i; j < fim; j++) {
+                int antes = cab.cabecalho.quant;
+                inserirOrdenado(arq, lote[j]);
+                inseridos += cab.cabecalho.quant - antes;
+            }
+            i = fim;
+            continue;
+        }
+
+        // Grava o excedente dos valores grandes, junto da folha
+        for (size_t k = 0; k < regs.size(); k++) {
+            if (origem[k] != -1 && regs[k].excedente) regs[k] = prepararCelula(arq, lote[origem[k]], folha);
+        }
+
+        // Retira da lista de livres as páginas das novas folhas
+        vector<int> posicoes(1, folha);
+        for (int k = 1; k < folhas; k++) posicoes.push_back(alocarPagina(arq, posicoes.back() + 1));
+
+        // Distribui os bytes por igual entre as folhas, encadeadas em ordem
+        int proxima = l->folha.next;
+        for (int k = 0; k < folhas; k++) {
+            pagina *p = (k == 0) ? l : fixar(arq, posicoes[k], true);
+            p->folha.tipo = PAGINA_FOLHA;
+            montarFolha(*p, tamPagina, &regs[cortes[k]], cortes[k + 1] - cortes[k]);
+            if (k > 0) p->folha.prev = posicoes[k - 1];
+            p->folha.next = (k + 1 < folhas) ? posicoes[k + 1] : proxima;
+            desafixar(arq, posicoes[k], true);
+        }
+        if (folhas > 1) {
+            if (proxima != -1) {
+                pagina *p = fixar(arq, proxima);
+                p->folha.prev = posicoes.back();
+                desafixar(arq, proxima, true);
+            } else {
+                cab.cabecalho.last = posicoes.back();
+            }
+        }
+
+        // Um separador por folha nova; a descida pela menor chave da folha
+        // chega à folha anterior, ainda sem o separador. O caminho original
+        // continua preso até o fim, para que nenhuma busca chegue às folhas
+        // redistribuídas antes de os separadores estarem no índice
+        for (int k = 1; k < folhas; k++) {
+            caminho s;
+            tipoChave separador = regs[cortes[k]].chave;
+            int anterior = descer(arq, separador, s);
+            desafixar(arq, anterior, false);
+            inserirSeparador(arq, s, separador, posicoes[k]);
+            soltarCaminho(arq, s);
+        }
+        soltarCaminho(arq, c);
+
+        inseridos += novos;
+        cab.cabecalho.quant += novos;
+        arq.cabSujo = true;
+        i = fim;
+
+        // Páginas não confirmadas não podem sair do cache: um lote grande é
+        // confirmado em partes, sempre entre duas folhas
+        if (arq.alteradas.size() > arq.quadros.size() / 4) {
+            confirmar(arq);
+            iniciarEscrita(arq);
+        }
+    }
+
+    return inseridos;
+}
+
+/**
+ * @brief Pesquisa um registro pela chave
+ * @param arq Arquivo aberto
+ * @param chave Chave a ser pesquisada
+ * @param resultado Referência para armazenar o registro encontrado
+ * @param ref Se não for NULL, recebe a localização do registro encontrado
+ *            (para removerReferencia)
+ * @return true se encontrou, false caso contrário
+ *
+ * Desce pelo índice até a única folha que pode conter a chave e faz
+ * busca binária nos registros dessa folha. Tenta antes a leitura
+ * otimista (descerOtimista); só fixa e trava as páginas se ela falhar
+ * TENTATIVAS_OTIMISTAS vezes. Uma chave que o filtro de Bloom descarta
+ * não lê página nenhuma.
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+bool pesquisa(arquivo &arq, tipoChave chave, dados &resultado, referencia *ref = NULL) {
+    ESTATISTICA(arq, ESTAT_PESQUISA);
+    if (!talvezContenha(arq.filtro, chave)) {
+        CONTAR(CONT_FILTRADAS, 1);
+        return false;
+    }
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    int cap = capacidadeFolha(tamPagina);
+
+    // Leitura otimista: sem fixar nem travar páginas. Um valor no excedente
+    // é lido pelo caminho com travas, que impede sua liberação no meio
+    if (!arq.mapa) {
+        for (int t = 0; t < TENTATIVAS_OTIMISTAS; t++) {
+            CONTAR(CONT_OTIMISTAS, 1);
+            int folha;
+            unsigned long long versao;
+            int q = descerOtimista(arq, chave, folha, versao);
+            if (q == -1) continue;
+            pagina &l = arq.memoria[q];
+            int quant = lerCampo(l.folha.quant);
+            if (lerCampo(l.folha.tipo) != PAGINA_FOLHA || quant < 0 || quant > cap) continue;
+            int i = posicaoRegistro(l, quant, chave);
+            celula copia;
+            bool valida = i >= quant || copiarCelula(l, quant, i, tamPagina, copia);
+            if (!validarLeitura(arq, q, versao) || !valida) continue;
+            bool achou = i < quant && copia.chave == chave;
+            if (achou && copia.excedente) break;
+            if (achou) resultado = dados{copia.chave, copia.carga};
+            if (achou && ref) *ref = referencia{folha, i, chave};
+            return achou;
+        }
+    }
+
+    int folha;
+    pagina &l = *buscarFolha(arq, chave, folha);
+    int i = posicaoRegistro(l, chave);
+    bool achou = i < l.folha.quant && l.folha.chave[i] == chave;
+    if (achou) resultado = dados{chave, valorCelula(arq, lerCelula(l, i))};
+    if (achou && ref) *ref = referencia{folha, i, chave};
+    desafixar(arq, folha, false);
+    return achou;
+}
+
+/**
+ * @struct buscaLote
+ * @brief Estado de uma pesquisaLote durante a descida compartilhada
+ */
+struct buscaLote {
+    const vector<tipoChave> &chaves;  ///< Chaves na ordem de quem chamou
+    vector<int> ordem;                ///< Índices de chaves em ordem crescente de chave
+    vector<dados> &resultados;        ///< Registro de cada chave encontrada
+    vector<bool> &achados;            ///< Se cada chave foi encontrada
+    int encontrados;                  ///< Quantas chaves foram encontradas
+};
+
+/**
+ * @brief Adianta para o cache do processador o início de uma página do buffer pool
+ * @param arq Arquivo aberto
+ * @param pos Número da página
+ *
+ * Só uma dica: a página pode nem estar no quadro indicado.
+ */
+void anteciparMemoria(arquivo &arq, int pos) {
+    const char *p;
+    if (arq.mapa) {
+        p = arq.mapa + (size_t)pos*arq.cab.cabecalho.tamPagina;
+    } else {
+        int i = arq.dica[pos & arq.mascaraDica].load(memory_order_relaxed);
+        if (i == -1) return;
+        p = (const char*)&arq.memoria[i];
+    }
+    __builtin_prefetch(p);
+    __builtin_prefetch(p + 64);
+}
+
+/**
+ * @brief Procura as chaves ordem[ini..fim) na subárvore de uma página fixada
+ * @param arq Arquivo aberto
+ * @param no Página fixada (desafixada por quem chamou)
+ * @param nivel Nível da página (0 na raiz)
+ * @param altura Altura da árvore
+ * @param b Estado da pesquisa
+ * @param ini Primeira posição de b.ordem
+ * @param fim Posição de b.ordem depois da última
+ *
+ * Numa página interna, reparte as chaves entre os filhos (elas estão em
+ * ordem, então cada filho recebe um trecho contíguo), lê de uma vez os
+ * filhos que faltam no cache (anteciparLista) e desce em cada um,
+ * adiantando a memória do próximo enquanto processa o atual. A página
+ * fica fixada enquanto os filhos são visitados, como na descida com
+ * travas de pesquisa. Numa folha, localiza todas as chaves, adianta os
+ * valores encontrados e só depois os copia.
+ */
+void pesquisarSubarvore(arquivo &arq, pagina &no, int nivel, int altura, buscaLote &b, size_t ini, size_t fim) {
+    if (nivel == altura) {
+        int quant = no.folha.quant;
+        vector<int> posicoes(fim - ini);
+        int inicio = 0;
+        slot *s = slotsFolha(no, quant);
+        for (size_t k = ini; k < fim; k++) {
+            tipoChave chave = b.chaves[b.ordem[k]];
+            int i = inicio + procurarChave(no.folha.chave + inicio, quant - inicio, chave);
+            posicoes[k - ini] = i;
+            if (i < quant && no.folha.chave[i] == chave) __builtin_prefetch(no.bytes + s[i].pos);
+            inicio = i;
+        }
+        for (size_t k = ini; k < fim; k++) {
+            int i = posicoes[k - ini], j = b.ordem[k];
+            if (i >= quant || no.folha.chave[i] != b.chaves[j]) continue;
+            b.resultados[j] = dados{b.chaves[j], valorCelula(arq, lerCelula(no, i))};
+            b.achados[j] = true;
+            b.encontrados++;
+        }
+        return;
+    }
+
+    // Trechos de chaves de cada filho
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    vector<int> filhos;
+    vector<size_t> cortes;
+    for (size_t k = ini; k < fim; k++) {
+        int filho = filhoInterna(no, tamPagina, posicaoFilho(no, b.chaves[b.ordem[k]]));
+        if (filhos.empty() || filhos.back() != filho) {
+            filhos.push_back(filho);
+            cortes.push_back(k);
+        }
+    }
+    cortes.push_back(fim);
+    anteciparLista(arq, filhos.data(), filhos.size());
+
+    for (size_t g = 0; g < filhos.size(); g++) {
+        if (g + 1 < filhos.size()) anteciparMemoria(arq, filhos[g + 1]);
+        pagina *filho = fixar(arq, filhos[g]);
+        pesquisarSubarvore(arq, *filho, nivel + 1, altura, b, cortes[g], cortes[g + 1]);
+        desafixar(arq, filhos[g], false);
+    }
+}
+
+/**
+ * @brief Pesquisa várias chaves de uma vez, com uma descida compartilhada
+ * @param arq Arquivo aberto
+ * @param chaves Chaves a pesquisar (podem vir fora de ordem e repetidas)
+ * @param resultados Recebe, na posição de cada chave, o registro encontrado
+ * @param achados Recebe, na posição de cada chave, se ela foi encontrada
+ * @return Quantidade de chaves encontradas
+ *
+ * As chaves são ordenadas e descem juntas pelo índice: cada página
+ * interna e cada folha é visitada uma vez por lote, não uma vez por
+ * chave, e os filhos de cada página são lidos do disco em um único lote
+ * de leituras (pesquisarSubarvore). As chaves descartadas pelo filtro
+ * de Bloom nem entram na descida. Os resultados voltam na ordem de
+ * chaves.
+ *
+ * Complexidade: O(m log m) para ordenar m chaves, além de no máximo
+ * O(min(m, n/B) log_B n) páginas lidas
+ */
+int pesquisaLote(arquivo &arq, const vector<tipoChave> &chaves, vector<dados> &resultados, vector<bool> &achados) {
+    ESTATISTICA(arq, ESTAT_PESQUISA);
+    buscaLote b = {chaves, vector<int>(), resultados, achados, 0};
+    resultados.assign(chaves.size(), dados());
+    achados.assign(chaves.size(), false);
+    b.ordem.reserve(chaves.size());
+    for (size_t k = 0; k < chaves.size(); k++) {
+        if (talvezContenha(arq.filtro, chaves[k])) b.ordem.push_back(k);
+    }
+    CONTAR(CONT_FILTRADAS, chaves.size() - b.ordem.size());
+    if (b.ordem.empty()) return 0;
+    sort(b.ordem.begin(), b.ordem.end(), [&chaves](int x, int y) { return tracos::menor(chaves[x], chaves[y]); });
+
+    arq.mRaiz.lock_shared();
+    int pos = arq.cab.cabecalho.raiz;
+    int altura = arq.cab.cabecalho.altura;
+    pagina *raiz = fixar(arq, pos);
+    arq.mRaiz.unlock_shared();
+    pesquisarSubarvore(arq, *raiz, 0, altura, b, 0, b.ordem.size());
+    desafixar(arq, pos, false);
+    CONTAR(CONT_DESCIDAS, 1);
+    return b.encontrados;
+}
+
+#define LEITURA_ANTECIPADA 16  ///< Folhas lidas de uma vez pelo cursor
+
+/**
+ * @struct cursor
+ * @brief Posição em um percurso ordenado pela lista de folhas
+ *
+ * O cursor fica entre dois registros: proximo devolve o registro à
+ * direita e anterior o registro à esquerda. O percurso fica restrito às
+ * chaves do intervalo [ini, fim] passado a posicionar.
+ *
+ * O cursor guarda uma cópia da folha atual, tirada de uma vez (copiarFolha),
+ * e devolve os registros dela sem tocar no cache; nenhuma página fica
+ * fixada entre as chamadas. Ao passar para a folha vizinha, ela só é
+ * aceita se ainda aponta de volta para a atual; senão houve uma divisão
+ * ou fusão no meio e a última chave devolvida é procurada de novo.
+ */
+struct cursor {
+    int folha;       ///< Página folha atual (-1 se o percurso terminou)
+    int i;           ///< Índice, na folha, do registro à direita do cursor
+    tipoChave ini, fim;  ///< Intervalo de chaves do percurso
+    int antecipadas; ///< Folhas seguintes já carregadas antecipadamente
+    bool iniciado;   ///< Algum registro já foi devolvido
+    tipoChave ultima;  ///< Última chave devolvida
+    bool depois;     ///< O cursor está depois de ultima (proximo) ou antes (anterior)
+    pagina copia;    ///< Cópia da folha atual
+    unsigned mudancas; ///< arq.mudancas antes da cópia
+};
+
+/**
+ * @brief Números das folhas que seguem uma folha, tirados da página acima dela
+ * @param arq Arquivo aberto
+ * @param chave Uma chave da folha
+ * @param folha Número da folha
+ * @param seguintes Recebe, em ordem, até max folhas seguintes
+ * @param max Quantidade máxima de folhas
+ *
+ * Só consulta a página interna que aponta para a folha: na última folha
+ * dela não devolve nada, e a folha seguinte (a primeira do próximo pai)
+ * volta a perguntar.
+ *
+ * Complexidade: O(log_B n) páginas fixadas, em geral já no cache
+ */
+void folhasSeguintes(arquivo &arq, tipoChave chave, int folha, vector<int> &seguintes, int max) {
+    arq.mRaiz.lock_shared();
+    int pos = arq.cab.cabecalho.raiz;
+    int altura = arq.cab.cabecalho.altura;
+    if (altura == 0) {
+        arq.mRaiz.unlock_shared();
+        return;
+    }
+    pagina *no = fixar(arq, pos);
+    arq.mRaiz.unlock_shared();
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    for (int nivel = 0; nivel < altura - 1; nivel++) {
+        int filho = filhoInterna(*no, tamPagina, posicaoFilho(*no, chave));
+        pagina *abaixo = fixar(arq, filho);
+        desafixar(arq, pos, false);
+        pos = filho;
+        no = abaixo;
+    }
+    int i = posicaoFilho(*no, chave);
+    if (filhoInterna(*no, tamPagina, i) == folha) {
+        for (int k = i + 1; k <= no->interna.quant && (int)seguintes.size() < max; k++) {
+            seguintes.push_back(filhoInterna(*no, tamPagina, k));
+        }
+    }
+    desafixar(arq, pos, false);
+}
+
+/**
+ * @brief Antecipa as folhas seguintes do percurso
+ * @param arq Arquivo aberto
+ * @param c Cursor que acabou de entrar em uma folha
+ *
+ * Folhas de uma carga em massa ou de divisões em sequência costumam
+ * ocupar páginas vizinhas; nesse caso as próximas LEITURA_ANTECIPADA
+ * páginas são lidas de uma vez em vez de uma leitura por folha. Se a
+ * próxima folha não é a página vizinha, os números das seguintes vêm da
+ * página interna acima da atual, e elas são lidas em um só lote, com as
+ * leituras em voo ao mesmo tempo, em vez de uma a uma seguindo next.
+ */
+void anteciparCursor(arquivo &arq, cursor &c) {
+    if (c.antecipadas > 0) {
+        c.antecipadas--;
+        return;
+    }
+    pagina &l = c.copia;
+    if (l.folha.next == -1 || l.folha.quant == 0) return;
+    if (l.folha.next == c.folha + 1) {
+        anteciparPaginas(arq, c.folha + 1, LEITURA_ANTECIPADA);
+        c.antecipadas = LEITURA_ANTECIPADA;
+        return;
+    }
+    vector<int> seguintes;
+    folhasSeguintes(arq, l.folha.chave[0], c.folha, seguintes, LEITURA_ANTECIPADA);
+    anteciparLista(arq, seguintes.data(), seguintes.size());
+    c.antecipadas = seguintes.size();
+}
+
+/**
+ * @brief Copia uma página inteira, de preferência sem travá-la
+ * @param arq Arquivo aberto
+ * @param pos Número da página
+ * @param destino Recebe a cópia
+ *
+ * Tenta a leitura otimista; se a página não estiver no cache ou continuar
+ * sendo alterada, fixa a página e copia com a trava de leitura.
+ */
+void copiarFolha(arquivo &arq, int pos, pagina &destino) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    if (!arq.mapa) {
+        for (int t = 0; t < TENTATIVAS_OTIMISTAS; t++) {
+            CONTAR(CONT_OTIMISTAS, 1);
+            unsigned long long versao;
+            int q = iniciarLeitura(arq, pos, versao);
+            if (q == -1) break;
+            memcpy(&destino, &arq.memoria[q], tamPagina);
+            if (validarLeitura(arq, q, versao)) return;
+        }
+    }
+    memcpy(&destino, fixar(arq, pos), tamPagina);
+    desafixar(arq, pos, false);
+}
+
+/**
+ * @brief Copia a folha que pode conter a chave
+ * @param arq Arquivo aberto
+ * @param chave Chave procurada
+ * @param destino Recebe a cópia da folha
+ * @return Número da página folha
+ */
+int copiarFolhaDaChave(arquivo &arq, tipoChave chave, pagina &destino) {
+    int tamPagina = arq.cab.cabecalho.tamPagina;
+    int folha;
+    if (!arq.mapa) {
+        for (int t = 0; t < TENTATIVAS_OTIMISTAS; t++) {
+            CONTAR(CONT_OTIMISTAS, 1);
+            unsigned long long versao;
+            int q = descerOtimista(arq, chave, folha, versao);
+            if (q == -1) continue;
+            memcpy(&destino, &arq.memoria[q], tamPagina);
+            if (validarLeitura(arq, q, versao) && destino.folha.tipo == PAGINA_FOLHA) return folha;
+        }
+    }
+    memcpy(&destino, buscarFolha(arq, chave, folha), tamPagina);
+    desafixar(arq, folha, false);
+    return folha;
+}
+
+/**
+ * @brief Confere se a posição do cursor condiz com a folha copiada
+ * @param c Cursor com a cópia da folha em c.copia
+ *
+ * A posição vale se os registros à esquerda e à direita dela continuam do
+ * lado certo da última chave devolvida (ou de ini, antes do primeiro).
+ */
+bool posicaoValida(cursor &c) {
+    pagina &l = c.copia;
+    if (l.folha.tipo != PAGINA_FOLHA || c.i > l.folha.quant) return false;
+    tipoChave chave = c.iniciado ? c.ultima : c.ini;
+    bool estrito = c.iniciado && c.depois;  // A própria chave fica à esquerda
+    if (c.i > 0) {
+        tipoChave esquerda = l.folha.chave[c.i - 1];
+        if (estrito ? esquerda > chave : esquerda >= chave) return false;
+    }
+    if (c.i < l.folha.quant) {
+        tipoChave direita = l.folha.chave[c.i];
+        if (estrito ? direita <= chave : direita < chave) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Procura de novo, a partir da raiz, a posição do cursor
+ * @param arq Arquivo aberto
+ * @param c Cursor
+ */
+void reposicionar(arquivo &arq, cursor &c) {
+    tipoChave chave = c.iniciado ? c.ultima : c.ini;
+    c.mudancas = arq.mudancas.load();
+    c.folha = copiarFolhaDaChave(arq, chave, c.copia);
+    pagina &l = c.copia;
+    c.i = posicaoRegistro(l, chave);
+    if (c.iniciado && c.depois && c.i < l.folha.quant && l.folha.chave[c.i] == chave) c.i++;
+}
+
+/**
+ * @brief Diz se nenhuma página foi movida desde a cópia anterior do cursor
+ * @param arq Arquivo aberto
+ * @param c Cursor que acabou de copiar a folha vizinha
+ *
+ * O encadeamento só prova que duas folhas são vizinhas enquanto cada
+ * página guarda a mesma folha; a compactação troca folhas de página, e aí
+ * o cursor procura a posição de novo a partir da raiz.
+ */
+bool semMudancas(arquivo &arq, cursor &c) {
+    unsigned agora = arq.mudancas.load();
+    return agora == c.mudancas && agora % 2 == 0;
+}
+
+/**
+ * @brief Posiciona o cursor antes da primeira chave >= ini
+ * @param arq Arquivo aberto
+ * @param c Cursor a ser posicionado
+ * @param ini Menor chave do intervalo
+ * @param fim Maior chave do intervalo
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+void posicionar(arquivo &arq, cursor &c, tipoChave ini, tipoChave fim) {
+    ESTATISTICA(arq, ESTAT_INTERVALO);
+    c.ini = ini;
+    c.fim = fim;
+    c.antecipadas = 0;
+    c.iniciado = false;
+    reposicionar(arq, c);
+    anteciparCursor(arq, c);
+}
+
+/**
+ * @brief Monta o registro de uma célula da cópia do cursor
+ * @param arq Arquivo aberto
+ * @param r Célula lida da cópia da folha
+ * @param d Recebe o registro
+ * @return false se o registro foi removido depois da cópia
+ *
+ * A cópia não protege o excedente, que pode ser liberado a qualquer
+ * momento; um valor grande é lido de novo por pesquisa.
+ */
+bool valorCursor(arquivo &arq, const celula &r, dados &d) {
+    if (r.excedente) return pesquisa(arq, r.chave, d);
+    d = dados{r.chave, r.carga};
+    return true;
+}
+
+/**
+ * @brief Avança o cursor e devolve o registro seguinte
+ * @param arq Arquivo aberto
+ * @param c Cursor posicionado
+ * @param d Recebe o registro
+ * @return false se não há mais registros no intervalo
+ *
+ * Complexidade: O(1) amortizado, uma página copiada por folha percorrida
+ */
+bool proximo(arquivo &arq, cursor &c, dados &d) {
+    ESTATISTICA(arq, ESTAT_INTERVALO);
+    while (c.folha != -1) {
+        pagina &l = c.copia;
+        if (c.i < l.folha.quant) {
+            bool dentro = l.folha.chave[c.i] <= c.fim;
+            if (dentro) {
+                celula r = lerCelula(l, c.i++);
+                c.iniciado = true;
+                c.ultima = r.chave;
+                c.depois = true;
+                if (!valorCursor(arq, r, d)) continue;
+            }
+            return dentro;
+        }
+
+        // Fim da folha: segue para a próxima, se ainda for a vizinha
+        int atual = c.folha;
+        int proxima = l.folha.next;
+        if (proxima == -1) return false;
+        copiarFolha(arq, proxima, c.copia);
+        c.folha = proxima;
+        c.i = 0;
+        if (semMudancas(arq, c) && l.folha.tipo == PAGINA_FOLHA && l.folha.prev == atual && posicaoValida(c)) {
+            anteciparCursor(arq, c);
+        } else {
+            reposicionar(arq, c);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Recua o cursor e devolve o registro anterior
+ * @param arq Arquivo aberto
+ * @param c Cursor posicionado
+ * @param d Recebe o registro
+ * @return false se não há registros anteriores no intervalo
+ *
+ * Complexidade: O(1) amortizado, uma página copiada por folha percorrida
+ */
+bool anterior(arquivo &arq, cursor &c, dados &d) {
+    ESTATISTICA(arq, ESTAT_INTERVALO);
+    while (c.folha != -1) {
+        pagina &l = c.copia;
+        if (c.i > 0) {
+            bool dentro = l.folha.chave[c.i - 1] >= c.ini;
+            if (dentro) {
+                celula r = lerCelula(l, --c.i);
+                c.iniciado = true;
+                c.ultima = r.chave;
+                c.depois = false;
+                if (!valorCursor(arq, r, d)) continue;
+            }
+            return dentro;
+        }
+
+        // Início da folha: volta para a anterior, se ainda for a vizinha
+        int atual = c.folha;
+        int volta = l.folha.prev;
+        if (volta == -1) return false;
+        copiarFolha(arq, volta, c.copia);
+        c.folha = volta;
+        c.i = l.folha.quant;
+        if (!(semMudancas(arq, c) && l.folha.tipo == PAGINA_FOLHA && l.folha.next == atual && posicaoValida(c))) {
+            reposicionar(arq, c);
+        }
+    }
+    return false;
+}
+
+#define FOLHAS_POR_TAREFA 16  ///< Maior quantidade de folhas lidas de uma vez por uma tarefa da varredura paralela
+
+/**
+ * @struct tarefaVarredura
+ * @brief Páginas de um mesmo nível que a varredura paralela ainda vai visitar
+ */
+struct tarefaVarredura {
+    int nivel;            ///< Nível das páginas (0 na raiz, a altura da árvore nas folhas)
+    vector<int> paginas;  ///< Uma página interna, ou folhas vizinhas lidas em um só lote
+};
+
+/**
+ * @struct filaTrabalho
+ * @brief Tarefas de um trabalhador da varredura, que os outros podem roubar
+ *
+ * O dono tira do fim (a tarefa mais recente, na subárvore que acabou de
+ * abrir); quem rouba tira do início, onde ficam as subárvores mais altas,
+ * que rendem mais trabalho por roubo.
+ */
+struct filaTrabalho {
+    mutex m;                         ///< Protege tarefas
+    deque<tarefaVarredura> tarefas;  ///< Tarefas ainda não começadas
+};
+
+/**
+ * @struct varreduraParalela
+ * @brief Estado compartilhado pelos trabalhadores de uma varredura
+ */
+struct varreduraParalela {
+    instantaneo inst;                 ///< Visão percorrida
+    tipoChave ini, fim;               ///< Intervalo de chaves
+    int porTarefa;                    ///< Folhas por tarefa
+    int trabalhadores;                ///< Quantidade de filas
+    unique_ptr<filaTrabalho[]> filas; ///< Uma fila por trabalhador
+    atomic<long long> pendentes;      ///< Tarefas criadas e ainda não terminadas
+};
+
+/**
+ * @brief Tira uma tarefa da própria fila ou, se está vazia, da de outro trabalhador
+ * @param v Varredura
+ * @param t Trabalhador
+ * @param tarefa Recebe a tarefa
+ * @return false se todas as filas estão vazias
+ */
+bool pegarTarefa(varreduraParalela &v, int t, tarefaVarredura &tarefa) {
+    {
+        lock_guard<mutex> trava(v.filas[t].m);
+        deque<tarefaVarredura> &minhas = v.filas[t].tarefas;
+        if (!minhas.empty()) {
+            tarefa = move(minhas.back());
+            minhas.pop_back();
+            return true;
+        }
+    }
+    for (int k = 1; k < v.trabalhadores; k++) {
+        filaTrabalho &outra = v.filas[(t + k) % v.trabalhadores];
+        lock_guard<mutex> trava(outra.m);
+        if (!outra.tarefas.empty()) {
+            tarefa = move(outra.tarefas.front());
+            outra.tarefas.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Transforma os filhos de uma página interna em tarefas do trabalhador
+ * @param v Varredura
+ * @param t Trabalhador
+ * @param no Página interna, lida do instantâneo
+ * @param nivel Nível da página
+ *
+ * Só entram os filhos que podem ter chaves no intervalo (o filho i fica
+ * entre os separadores i e i + 1). Folhas vizinhas na página vão juntas,
+ * até porTarefa por tarefa, para serem lidas em um só lote.
+ */
+void repartirFilhos(varreduraParalela &v, int t, pagina &no, int nivel) {
+    int tamPagina = v.inst.cab.cabecalho.tamPagina;
+    int de = 0, ate = no.interna.quant;
+    while (de < ate && separadorInterna(no, de + 1) <= v.ini) de++;
+    while (ate > de && separadorInterna(no, ate) > v.fim) ate--;
+    int passo = nivel + 1 == v.inst.cab.cabecalho.altura ? v.porTarefa : 1;
+
+    vector<tarefaVarredura> novas;
+    for (int i = de; i <= ate; i += passo) {
+        tarefaVarredura tarefa;
+        tarefa.nivel = nivel + 1;
+        for (int j = i; j <= ate && j < i + passo; j++) tarefa.paginas.push_back(filhoInterna(no, tamPagina, j));
+        novas.push_back(move(tarefa));
+    }
+    v.pendentes += novas.size();
+    lock_guard<mutex> trava(v.filas[t].m);
+    // Em ordem inversa, para que o dono siga pelo filho mais à esquerda
+    for (size_t k = novas.size(); k-- > 0; ) v.filas[t].tarefas.push_back(move(novas[k]));
+}
+
+/**
+ * @brief Laço de um trabalhador da varredura paralela
+ * @param arq Arquivo aberto
+ * @param v Varredura
+ * @param t Trabalhador
+ * @param porFolha Chamada com (t, instantâneo, folha, de, ate) para os
+ *                 registros de índices [de, ate) da folha que estão no intervalo
+ *
+ * Uma página interna vira tarefas dos seus filhos; as folhas de uma
+ * tarefa são antecipadas juntas (anteciparLista), com as leituras em voo
+ * ao mesmo tempo. O trabalhador só para quando não há tarefa em nenhuma
+ * fila nem tarefa em andamento que ainda possa criar outras.
+ */
+template <class F>
+void trabalharVarredura(arquivo &arq, varreduraParalela &v, int t, F &porFolha) {
+    int altura = v.inst.cab.cabecalho.altura;
+    tarefaVarredura tarefa;
+    pagina p;
+    while (true) {
+        if (!pegarTarefa(v, t, tarefa)) {
+            if (v.pendentes.load() == 0) return;
+            this_thread::yield();
+            continue;
+        }
+        if (tarefa.nivel < altura) {
+            lerInstantaneo(arq, v.inst, tarefa.paginas[0], p);
+            repartirFilhos(v, t, p, tarefa.nivel);
+        } else {
+            if (tarefa.paginas.size() > 1) anteciparLista(arq, tarefa.paginas.data(), tarefa.paginas.size());
+            for (size_t k = 0; k < tarefa.paginas.size(); k++) {
+                lerInstantaneo(arq, v.inst, tarefa.paginas[k], p);
+                tipoChave *chaves = p.folha.chave;
+                int de = lower_bound(chaves, chaves + p.folha.quant, v.ini) - chaves;
+                int ate = upper_bound(chaves, chaves + p.folha.quant, v.fim) - chaves;
+                if (de < ate) porFolha(t, v.inst, p, de, ate);
+            }
+        }
+        v.pendentes--;
+    }
+}
+
+/**
+ * @brief Percorre em paralelo as folhas com chaves no intervalo [ini, fim]
+ * @param arq Arquivo aberto, sem a vez de escrita com a thread atual
+ * @param ini Menor chave
+ * @param fim Maior chave
+ * @param threads Trabalhadores (a thread atual é um deles)
+ * @param porFolha Chamada para cada folha atingida, como em trabalharVarredura,
+ *                 por vários trabalhadores ao mesmo tempo e sem ordem definida
+ *
+ * O espaço de chaves é repartido pelos separadores do índice: um
+ * trabalhador começa pela raiz e cada página interna aberta vira uma
+ * tarefa por filho, que os trabalhadores sem tarefa roubam. Subárvores
+ * maiores ou mais lentas acabam divididas entre mais trabalhadores, sem
+ * precisar de uma divisão igual feita antes. As páginas são lidas de um
+ * instantâneo, então escritas no meio da varredura não são vistas.
+ *
+ * Complexidade: O(n / B) páginas lidas para n registros no intervalo,
+ * repartidas entre os trabalhadores
+ */
+template <class F>
+void varrerParalelo(arquivo &arq, tipoChave ini, tipoChave fim, int threads, F porFolha) {
+    if (threads < 1) threads = 1;
+    varreduraParalela v;
+    abrirInstantaneo(arq, v.inst);
+    v.ini = ini;
+    v.fim = fim;
+    v.porTarefa = std::max(1, std::min(FOLHAS_POR_TAREFA, (int)arq.quadros.size() / (4*threads)));
+    v.trabalhadores = threads;
+    v.filas.reset(new filaTrabalho[threads]);
+    v.pendentes.store(0);
+    if (ini <= fim && v.inst.cab.cabecalho.quant > 0) {
+        v.filas[0].tarefas.push_back({0, vector<int>(1, v.inst.cab.cabecalho.raiz)});
+        v.pendentes.store(1);
+    }
+
+    vector<thread> ajudantes;
+    for (int t = 1; t < threads; t++) {
+        ajudantes.emplace_back([&arq, &v, &porFolha, t]() { trabalharVarredura(arq, v, t, porFolha); });
+    }
+    trabalharVarredura(arq, v, 0, porFolha);
+    for (size_t k = 0; k < ajudantes.size(); k++) ajudantes[k].join();
+    fecharInstantaneo(arq, v.inst);
+}
+
+/**
+ * @brief Chama uma função para cada registro do intervalo [ini, fim], em paralelo
+ * @param arq Arquivo aberto, sem a vez de escrita com a thread atual
+ * @param ini Menor chave
+ * @param fim Maior chave
+ * @param threads Trabalhadores (a thread atual é um deles)
+ * @param visitar Chamada com (trabalhador, registro); trabalhadores
+ *                diferentes a chamam ao mesmo tempo e sem ordem entre as folhas
+ *
+ * O número do trabalhador (de 0 a threads - 1) permite acumular um
+ * resultado por trabalhador, sem travas, e juntá-los no fim.
+ *
+ * Complexidade: O(n / B + v / B) páginas lidas para n registros e v bytes de excedente
+ */
+template <class F>
+void percorrerParalelo(arquivo &arq, tipoChave ini, tipoChave fim, int threads, F visitar) {
+    varrerParalelo(arq, ini, fim, threads, [&arq, &visitar](int t, const instantaneo &inst, pagina &l, int de, int ate) {
+        dados d;
+        for (int i = de; i < ate; i++) {
+            celula c = lerCelula(l, i);
+            d.chave = c.chave;
+            d.nome = valorInstantaneo(arq, inst, c);
+            visitar(t, d);
+        }
+    });
+}
+
+/**
+ * @struct agregado
+ * @brief Resumo das chaves de um intervalo
+ */
+struct agregado {
+    long long quant;  ///< Registros no intervalo
+    tipoChave menor;  ///< Menor chave (só vale com quant > 0)
+    tipoChave maior;  ///< Maior chave (só vale com quant > 0)
+    long long soma;   ///< Soma das chaves (módulo 2^64)
+};
+
+/**
+ * @brief Conta os registros do intervalo [ini, fim] e resume as suas chaves, em paralelo
+ * @param arq Arquivo aberto, sem a vez de escrita com a thread atual
+ * @param ini Menor chave
+ * @param fim Maior chave
+ * @param threads Trabalhadores (a thread atual é um deles)
+ * @return Quantidade, menor e maior chave e soma das chaves
+ *
+ * Só lê a coluna de chaves de cada folha: os valores e o excedente não
+ * são tocados. Cada trabalhador acumula o seu resumo, juntado no fim.
+ *
+ * Complexidade: O(n / B) páginas lidas para n registros no intervalo
+ */
+agregado agregarIntervalo(arquivo &arq, tipoChave ini, tipoChave fim, int threads) {
+    if (threads < 1) threads = 1;
+    vector<agregado> parciais(threads, agregado{0, 0, 0, 0});
+    varrerParalelo(arq, ini, fim, threads, [&parciais](int t, const instantaneo &, pagina &l, int de, int ate) {
+        agregado &a = parciais[t];
+        unsigned long long soma = 0;
+        for (int i = de; i < ate; i++) soma += (unsigned long long)l.folha.chave[i];
+        if (a.quant == 0 || l.folha.chave[de] < a.menor) a.menor = l.folha.chave[de];
+        if (a.quant == 0 || l.folha.chave[ate - 1] > a.maior) a.maior = l.folha.chave[ate - 1];
+        a.quant += ate - de;
+        a.soma = (long long)((unsigned long long)a.soma + soma);
+    });
+
+    agregado total = {0, 0, 0, 0};
+    for (int t = 0; t < threads; t++) {
+        agregado &a = parciais[t];
+        if (a.quant == 0) continue;
+        if (total.quant == 0 || a.menor < total.menor) total.menor = a.menor;
+        if (total.quant == 0 || a.maior > total.maior) total.maior = a.maior;
+        total.quant += a.quant;
+        total.soma = (long long)((unsigned long long)total.soma + (unsigned long long)a.soma);
+    }
+    return total;
+}
+
+/**
+ * @brief Insere um novo registro
+ * @param arq Arquivo aberto
+ * @param d Dados a serem inseridos
+ *
+ * A folha de uma Árvore B+ precisa permanecer ordenada para que os
+ * separadores do índice continuem válidos, então a inserção sempre
+ * posiciona o registro pela chave. Quando a chave é maior que todas as
+ * existentes o resultado é o mesmo de antes: o registro vai para o final.
+ *
+ * Complexidade: O(log_B n)
+ */
+void inserir(arquivo &arq, dados d) {
+    inserirOrdenado(arq, d);
+}
+
+/**
+ * @brief Junta os registros de duas folhas vizinhas
+ * @param esquerda Folha da esquerda
+ * @param direita Folha da direita
+ * @return Registros das duas, em ordem
+ */
+vector<celula> juntarFolhas(pagina &esquerda, pagina &direita) {
+    vector<celula> regs;
+    lerCelulas(esquerda, 0, esquerda.folha.quant, regs);
+    lerCelulas(direita, 0, direita.folha.quant, regs);
+    return regs;
+}
+
+/**
+ * @brief Divide por igual os bytes de duas folhas vizinhas
+ * @param esquerda Folha da esquerda
+ * @param direita Folha da direita
+ * @param tamPagina Tamanho da página em bytes
+ */
+void redistribuirFolhas(pagina &esquerda, pagina &direita, int tamPagina) {
+    vector<celula> regs = juntarFolhas(esquerda, direita);
+    size_t corte = dividirCelulas(regs, 2)[1];
+    montarFolha(esquerda, tamPagina, regs.data(), corte);
+    montarFolha(direita, tamPagina, &regs[corte], regs.size() - corte);
+}
+
+/**
+ * @brief Corrige uma folha que ficou abaixo da ocupação mínima
+ * @param arq Arquivo aberto
+ * @param c Caminho da descida até a folha (liberado pela função)
+ * @param folha Número da folha, fixada em c.folha (desafixada pela função)
+ *
+ * Se a folha e uma irmã juntas têm bytes para duas folhas com a ocupação
+ * mínima (minimoFolha) mesmo com um registro máximo de sobra, os
+ * registros são redistribuídos por igual entre elas; senão a folha se
+ * funde com a irmã, devolvendo uma página à lista de livres, e o índice é
+ * corrigido a partir do pai. A raiz folha pode ficar com qualquer
+ * quantidade.
+ */
+void corrigirFolha(arquivo &arq, caminho &c, int folha) {
+    pagina &cab = arq.cab;
+    pagina &l = *c.folha;
+    int tamPagina = cab.cabecalho.tamPagina;
+    int minimo = minimoFolha(tamPagina, cab.cabecalho.limiar);
+    int rmax = registroMaximo(cab.cabecalho.limiar);
+
+    if (c.altura == 0 || ocupacaoFolha(l, tamPagina) >= minimo) {
+        desafixar(arq, folha, true);
+        soltarCaminho(arq, c);
+        return;
+    }
+
+    pagina &pai = *c.no[c.altura - 1];
+    int j = c.ind[c.altura - 1];
+    marcarSuja(arq, c.pos[c.altura - 1]);
+
+    if (j > 0) {
+        int posIrma = filhoInterna(pai, tamPagina, j - 1);
+        pagina &irma = *fixar(arq, posIrma);
+
+        // Redistribuição com a irmã esquerda: os maiores dela vêm para o início
+        int total = ocupacaoFolha(l, tamPagina) + ocupacaoFolha(irma, tamPagina);
+        if (total >= 2*(minimo + rmax)) {
+            redistribuirFolhas(irma, l, tamPagina);
+            escreverSeparador(pai, j, l.folha.chave[0]);
+            desafixar(arq, posIrma, true);
+            desafixar(arq, folha, true);
+            soltarCaminho(arq, c);
+            return;
+        }
+
+        // Fusão com a irmã esquerda: os registros restantes vão para ela
+        vector<celula> regs = juntarFolhas(irma, l);
+        montarFolha(irma, tamPagina, regs.data(), regs.size());
+        irma.folha.next = l.folha.next;
+        if (l.folha.next != -1) {
+            pagina *proxima = fixar(arq, l.folha.next);
+            proxima->folha.prev = posIrma;
+            desafixar(arq, l.folha.next, true);
+        } else {
+            cab.cabecalho.last = posIrma;
+        }
+        desafixar(arq, posIrma, true);
+        desafixar(arq, folha, false);
+        liberarPagina(arq, folha);
+        moverEntradas(pai, j, pai, j + 1, pai.interna.quant - j, tamPagina);
+    } else {
+        int posIrma = filhoInterna(pai, tamPagina, j + 1);
+        pagina &irma = *fixar(arq, posIrma);
+
+        // Redistribuição com a irmã direita: os menores dela vêm para o final
+        int total = ocupacaoFolha(l, tamPagina) + ocupacaoFolha(irma, tamPagina);
+        if (total >= 2*(minimo + rmax)) {
+            redistribuirFolhas(l, irma, tamPagina);
+            escreverSeparador(pai, j + 1, irma.folha.chave[0]);
+            desafixar(arq, posIrma, true);
+            desafixar(arq, folha, true);
+            soltarCaminho(arq, c);
+            return;
+        }
+
+        // Fusão com a irmã direita: os registros dela vêm para esta folha
+        vector<celula> regs = juntarFolhas(l, irma);
+        montarFolha(l, tamPagina, regs.data(), regs.size());
+        l.folha.next = irma.folha.next;
+        if (irma.folha.next != -1) {
+            pagina *proxima = fixar(arq, irma.folha.next);
+            proxima->folha.prev = folha;
+            desafixar(arq, irma.folha.next, true);
+        } else {
+            cab.cabecalho.last = folha;
+        }
+        desafixar(arq, folha, true);
+        desafixar(arq, posIrma, false);
+        liberarPagina(arq, posIrma);
+        moverEntradas(pai, j + 1, pai, j + 2, pai.interna.quant - j - 1, tamPagina);
+    }
+
+    // O pai perdeu um filho: corrige o índice a partir dele
+    pai.interna.quant--;
+    ajustarIndice(arq, c, c.altura - 1);
+    soltarCaminho(arq, c);
+}
+
+/**
+ * @brief Remove um registro pela chave
+ * @param arq Arquivo aberto
+ * @param chave Chave do registro a ser removido
+ * @return true se removeu com sucesso, false se não encontrou
+ *
+ * Esta função:
+ * 1. Localiza o registro descendo pelo índice e por busca binária na folha
+ *    (uma chave descartada pelo filtro de Bloom não desce)
+ * 2. Retira o registro da folha e libera o seu excedente
+ * 3. Se a folha ficar abaixo da ocupação mínima, redistribui com a folha
+ *    irmã ou se funde com ela (corrigirFolha)
+ * 4. Atualiza o índice e o cabeçalho
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+bool remover(arquivo &arq, tipoChave chave) {
+    ESTATISTICA(arq, ESTAT_REMOCAO);
+    pagina &cab = arq.cab;
+    caminho c;
+    if (!talvezContenha(arq.filtro, chave)) {
+        CONTAR(CONT_FILTRADAS, 1);
+        return false;
+    }
+
+    // Procura o registro
+    iniciarEscrita(arq);
+    int folha = descer(arq, chave, c, DESCIDA_REMOCAO);
+    pagina &l = *c.folha;
+    int i = posicaoRegistro(l, chave);
+    if (i == l.folha.quant || l.folha.chave[i] != chave) {
+        desafixar(arq, folha, false);
+        soltarCaminho(arq, c);
+        return false;
+    }
+
+    // Retira o registro da folha
+    celula antiga = lerCelula(l, i);
+    removerCelulas(l, i, 1);
+    liberarCelula(arq, antiga);
+    cab.cabecalho.quant--;
+    arq.cabSujo = true;
+
+    corrigirFolha(arq, c, folha);
+    return true;
+}
+
+/**
+ * @brief Pesquisa um registro e devolve a sua localização
+ * @param arq Arquivo aberto
+ * @param chave Chave a ser pesquisada
+ * @param r Recebe a localização do registro
+ * @return true se encontrou
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+bool localizar(arquivo &arq, tipoChave chave, referencia &r) {
+    if (!talvezContenha(arq.filtro, chave)) {
+        CONTAR(CONT_FILTRADAS, 1);
+        return false;
+    }
+    int folha;
+    pagina &l = *buscarFolha(arq, chave, folha);
+    int i = posicaoRegistro(l, chave);
+    bool achou = i < l.folha.quant && l.folha.chave[i] == chave;
+    if (achou) {
+        r.folha = folha;
+        r.i = i;
+        r.chave = chave;
+    }
+    desafixar(arq, folha, false);
+    return achou;
+}
+
+/**
+ * @brief Remove o registro de uma localização obtida antes
+ * @param arq Arquivo aberto
+ * @param r Localização devolvida por localizar ou gravarRegistro
+ * @return true se removeu, false se a chave não existe mais
+ *
+ * Se a localização ainda aponta para a chave e a folha não fica abaixo
+ * da ocupação mínima, o registro sai direto da folha, sem descer pelo
+ * índice. Caso contrário (localização desatualizada ou folha que precisa
+ * ser corrigida), usa a remoção normal pela chave.
+ *
+ * Complexidade: O(1) páginas lidas no caso comum, O(log_B n) no pior caso
+ */
+bool removerReferencia(arquivo &arq, referencia r) {
+    ESTATISTICA(arq, ESTAT_REMOCAO);
+    pagina &cab = arq.cab;
+    iniciarEscrita(arq);
+    if (r.folha >= 1 && r.folha <= cab.cabecalho.alto) {
+        int tamPagina = cab.cabecalho.tamPagina;
+        int minimo = minimoFolha(tamPagina, cab.cabecalho.limiar);
+        pagina &l = *fixar(arq, r.folha);
+        bool valida = l.folha.tipo == PAGINA_FOLHA && r.i >= 0 && r.i < l.folha.quant &&
+                      l.folha.chave[r.i] == r.chave;
+        celula antiga;
+        if (valida) antiga = lerCelula(l, r.i);
+        if (valida && (ocupacaoFolha(l, tamPagina) - tamanhoCelula(antiga) >= minimo || r.folha == cab.cabecalho.raiz)) {
+            removerCelulas(l, r.i, 1);
+            liberarCelula(arq, antiga);
+            desafixar(arq, r.folha, true);
+            cab.cabecalho.quant--;
+            arq.cabSujo = true;
+            return true;
+        }
+        desafixar(arq, r.folha, false);
+    }
+    return remover(arq, r.chave);
+}
+
+/**
+ * @brief Remove todos os registros com chave no intervalo [ini, fim]
+ * @param arq Arquivo aberto
+ * @param ini Menor chave do intervalo
+ * @param fim Maior chave do intervalo
+ * @return Quantidade de registros removidos
+ *
+ * Uma descida por folha atingida, em vez de uma por registro: os
+ * registros do intervalo saem da folha com um único deslocamento e a
+ * folha é corrigida uma vez (corrigirFolha). Como na inserção em lote,
+ * uma remoção grande é confirmada em partes, sempre entre duas folhas; os
+ * registros de uma mesma folha também são divididos em partes quando o
+ * excedente liberado não caberia em um quarto do cache.
+ *
+ * Complexidade: O(k/B · log_B n) páginas lidas para k registros removidos
+ */
+int removerIntervalo(arquivo &arq, tipoChave ini, tipoChave fim) {
+    ESTATISTICA(arq, ESTAT_REMOCAO);
+    pagina &cab = arq.cab;
+    int removidos = 0;
+    int orcamento = std::max(1, (int)arq.quadros.size() / 4);
+    iniciarEscrita(arq);
+
+    while (ini <= fim) {
+        caminho c;
+        int folha = descer(arq, ini, c);
+        pagina &l = *c.folha;
+        int a = posicaoRegistro(l, ini);
+        int b = a;
+        int paginas = 0;
+        while (b < l.folha.quant && l.folha.chave[b] <= fim) {
+            celula r = lerCelula(l, b);
+            int n = r.excedente ? paginasValor(arq, lerReferencia(r).comprimento) : 0;
+            if (b > a && paginas + n > orcamento) break;
+            paginas += n;
+            b++;
+        }
+
+        // O intervalo pode continuar na mesma folha ou na próxima
+        bool continua = false;
+        if (b < l.folha.quant && l.folha.chave[b] <= fim) {
+            continua = true;
+            ini = l.folha.chave[b];
+        } else if (b == l.folha.quant && l.folha.next != -1) {
+            pagina *proxima = fixar(arq, l.folha.next);
+            continua = proxima->folha.quant > 0 && proxima->folha.chave[0] <= fim;
+            if (continua) ini = proxima->folha.chave[0];
+            desafixar(arq, l.folha.next, false);
+        }
+
+        if (b == a) {
+            desafixar(arq, folha, false);
+            soltarCaminho(arq, c);
+        } else {
+            vector<celula> antigas;
+            lerCelulas(l, a, b - a, antigas);
+            removerCelulas(l, a, b - a);
+            for (size_t k = 0; k < antigas.size(); k++) liberarCelula(arq, antigas[k]);
+            removidos += b - a;
+            cab.cabecalho.quant -= b - a;
+            arq.cabSujo = true;
+            corrigirFolha(arq, c, folha);
+        }
+        if (!continua) break;
+
+        if (arq.alteradas.size() > arq.quadros.size() / 4) {
+            confirmar(arq);
+            iniciarEscrita(arq);
+        }
+    }
+    return removidos;
+}
+
+/**
+ * @brief Copia uma página da árvore para outra posição e corrige quem aponta para ela
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ * @param origem Página em uso (folha, interna ou excedente)
+ * @param destino Página que não está em uso (livre ou além da marca alto)
+ *
+ * O pai é encontrado descendo por uma chave da própria página (a primeira
+ * da folha, o primeiro separador da página interna ou a chave dona do
+ * excedente), com o caminho inteiro travado. Além do ponteiro do pai (ou
+ * da raiz no cabeçalho), uma folha tem as vizinhas e first/last
+ * corrigidos. Uma página de excedente não tem pai: quem aponta para ela é
+ * a página anterior do valor ou, na primeira, a referência na folha dona,
+ * e a seguinte aponta de volta. A origem é marcada como
+ * livre, e arq.mudancas fica ímpar durante a mudança, para que um cursor
+ * com o encadeamento antigo não o siga (semMudancas).
+ *
+ * Complexidade: O(log_B n) páginas lidas
+ */
+void moverPagina(arquivo &arq, int origem, int destino) {
+    pagina &cab = arq.cab;
+    int tamPagina = cab.cabecalho.tamPagina;
+
+    // A chave é lida antes da descida: as travas são sempre tomadas de cima para baixo
+    pagina *o = fixar(arq, origem);
+    int tipo = o->folha.tipo;
+    bool ehFolha = tipo == PAGINA_FOLHA;
+    tipoChave chave = ehFolha ? o->folha.chave[0] : tipo == PAGINA_INTERNA ? separadorInterna(*o, 1) : o->excedente.chave;
+    desafixar(arq, origem, false);
+
+    caminho c;
+    int folha = descer(arq, chave, c);
+    bool folhaSuja = false;
+    arq.mudancas++;
+    o = fixar(arq, origem);
+    pagina *d = fixar(arq, destino, true);
+    memcpy(d, o, tamPagina);
+
+    if (tipo == PAGINA_EXCEDENTE) {
+        if (d->excedente.prev != -1) {
+            pagina *p = fixar(arq, d->excedente.prev);
+            p->excedente.next = destino;
+            desafixar(arq, d->excedente.prev, true);
+        } else {
+            pagina &l = *c.folha;
+            slot s = slotsFolha(l, l.folha.quant)[posicaoRegistro(l, chave)];
+            referenciaExcedente r;
+            memcpy(&r, l.bytes + s.pos, sizeof(r));
+            r.pagina = destino;
+            memcpy(l.bytes + s.pos, &r, sizeof(r));
+            folhaSuja = true;
+        }
+        if (d->excedente.next != -1) {
+            pagina *p = fixar(arq, d->excedente.next);
+            p->excedente.prev = destino;
+            desafixar(arq, d->excedente.next, true);
+        }
+    } else if (origem == cab.cabecalho.raiz) {
+        cab.cabecalho.raiz = destino;
+        arq.cabSujo = true;
+        publicarRaiz(arq);
+    } else {
+        for (int nivel = 0; nivel < c.altura; nivel++) {
+            int &filho = filhoInterna(*c.no[nivel], tamPagina, c.ind[nivel]);
+            if (filho == origem) {
+                filho = destino;
+                marcarSuja(arq, c.pos[nivel]);
+                break;
+            }
+        }
+    }
+
+    if (ehFolha) {
+        if (d->folha.prev != -1) {
+            pagina *p = fixar(arq, d->folha.prev);
+            p->folha.next = destino;
+            desafixar(arq, d->folha.prev, true);
+        } else {
+            cab.cabecalho.first = destino;
+            arq.cabSujo = true;
+        }
+        if (d->folha.next != -1) {
+            pagina *p = fixar(arq, d->folha.next);
+            p->folha.prev = destino;
+            desafixar(arq, d->folha.next, true);
+        } else {
+            cab.cabecalho.last = destino;
+            arq.cabSujo = true;
+        }
+    }
+
+    memset(o, 0, tamPagina);
+    o->livre.tipo = PAGINA_LIVRE;
+    o->livre.next = o->livre.prev = -1;
+    desafixar(arq, destino, true);
+    desafixar(arq, origem, true);
+    desafixar(arq, folha, folhaSuja);
+    soltarCaminho(arq, c);
+    arq.mudancas++;
+}
+
+/**
+ * @brief Troca de lugar duas páginas em uso
+ * @param arq Arquivo aberto (vez de escrita com a thread atual)
+ * @param a Uma página da árvore
+ * @param b Outra página da árvore
+ * @return false se não foi possível obter a página auxiliar
+ *
+ * Usa como intermediária a página seguinte à marca alto (crescendo o
+ * arquivo se preciso), que volta a ficar sem uso ao final.
+ */
+bool trocarPaginas(arquivo &arq, int a, int b) {
+    pagina &cab = arq.cab;
+    if (cab.cabecalho.alto == cab.cabecalho.tam && !crescerArquivo(arq, 1)) return false;
+    int auxiliar = cab.cabecalho.alto + 1;
+    moverPagina(arq, b, auxiliar);
+    moverPagina(arq, a, b);
+    moverPagina(arq, auxiliar, a);
+    return true;
+}
+
+/**
+ * @brief Compacta o arquivo aos poucos, devolvendo a localidade da lista de folhas
+ * @param arq Arquivo aberto
+ * @param passos Máximo de páginas colocadas nesta chamada
+ * @return Páginas colocadas (0 quando o arquivo já está compactado)
+ *
+ * Depois de muitas remoções e inserções, a lista de livres (LIFO) espalha
+ * pelo arquivo folhas vizinhas na ordem das chaves, e percorrer a lista
+ * de folhas vira leitura aleatória. A compactação tem duas fases:
+ * 1. Enquanto há páginas livres, a última página usada (marca alto) vai
+ *    para o menor buraco; uma página livre no topo apenas sai da lista.
+ *    A marca alto desce a cada passo e, ao final, todas as páginas livres
+ *    formam um bloco contínuo depois dela.
+ * 2. Com a lista de livres vazia, a k-ésima folha da lista passa a ocupar
+ *    a página k, trocando de lugar com quem está lá (em geral uma página
+ *    interna, que vai para o fim).
+ *
+ * Cada passo deixa a árvore consistente, então a compactação pode ser
+ * interrompida a qualquer momento e retomada por outra chamada, entre
+ * outras operações. As folhas já colocadas são lembradas em
+ * arq.folhasOrdenadas, que volta a zero quando uma página é alocada ou
+ * liberada (a lista de folhas pode ter mudado). Como nas outras
+ * operações grandes, o trabalho é confirmado em partes.
+ *
+ * Complexidade: O(passos · log_B n) páginas lidas
+ */
+int compactar(arquivo &arq, int passos) {
+    ESTATISTICA(arq, ESTAT_COMPACTACAO);
+    pagina &cab = arq.cab;
+    int feitos = 0;
+    iniciarEscrita(arq);
+    if (!arq.mapaLivres) mapearLivres(arq);
 
-    // Configuração inicial do cabeçalho
-    cab.cabecalho.quant = 0;    // Nenhum registro inserido
-    cab.cabecalho.first = -1;   // Lista vazia
-    cab.cabecalho.last = -1;    // Lista vazia
-    cab.cabecalho.free = 1;     // Primeira posição livre é 1
-    cab.cabecalho.tam = n;      // Capacidade total
+    // Fase 1: esvazia a lista de livres levando o topo do arquivo para os buracos
+    while (feitos < passos && cab.cabecalho.free != -1) {
+        int topo = cab.cabecalho.alto;
+        if (arq.livresOrdem.count(topo)) {
+            retirarLivre(arq, topo);
+        } else {
+            int destino = *arq.livresOrdem.begin();
+            retirarLivre(arq, destino);
+            moverPagina(arq, topo, destino);
+            feitos++;
+        }
+        cab.cabecalho.alto--;
+        arq.cabSujo = true;
+
+        if (arq.alteradas.size() > arq.quadros.size() / 4) {
+            confirmar(arq);
+            iniciarEscrita(arq);
+        }
+    }
+    if (cab.cabecalho.free != -1) return feitos;
 
-    // Escreve o cabeçalho no arquivo
-    arq.write((char*)&cab, sizeof(cab));
+    // Fase 2: retoma depois da última folha colocada, se ela ainda está no lugar
+    int k = 0;
+    int folha = cab.cabecalho.first;
+    int ultima = arq.folhasOrdenadas;
+    if (ultima > 0 && ultima <= cab.cabecalho.alto) {
+        pagina *l = fixar(arq, ultima);
+        if (l->folha.tipo == PAGINA_FOLHA && l->folha.prev == (ultima == 1 ? -1 : ultima - 1)) {
+            k = ultima;
+            folha = l->folha.next;
+        }
+        desafixar(arq, ultima, false);
+    }
+
+    while (folha != -1 && feitos < passos) {
+        if (folha != k + 1) {
+            if (!trocarPaginas(arq, folha, k + 1)) {
+                cout << "Erro: nao foi possivel concluir a compactacao.\n";
+                break;
+            }
+            feitos++;
+        }
+        k++;
 
-    // Inicializa todos os nós como livres
-    for (int i = 1; i <= cab.cabecalho.tam; i++) {
-        // Encadeamento dos nós livres:
-        // Cada nó aponta para o próximo, exceto o último que aponta para -1
-        l.lista.next = (i == n) ? -1 : i + 1;
-        l.lista.prev = -1;      // Nós livres não usam prev
-        l.lista.reg.chave = -1; // Marcação explícita como livre
-        arq.write((char*)&l, sizeof(l));
+        // Outra escrita pode entrar durante a confirmação e fundir a folha k
+        if (arq.alteradas.size() > arq.quadros.size() / 4) {
+            confirmar(arq);
+            iniciarEscrita(arq);
+        }
+        pagina *l = fixar(arq, k);
+        bool continua = l->folha.tipo == PAGINA_FOLHA;
+        folha = l->folha.next;
+        desafixar(arq, k, false);
+        if (!continua) {
+            k = 0;
+            break;
+        }
     }
+    arq.folhasOrdenadas = k;
+    return feitos;
 }
 
 /**
- * @brief Imprime toda a estrutura do arquivo
- * @param arq Referência para o arquivo já aberto
- * 
- * Mostra:
- * - Todos os metadados do cabeçalho
- * - Todos os registros (ativos e livres) com seus dados completos
- * 
- * Complexidade: O(n) onde n é o número máximo de registros
+ * @brief Muda a forma como uma folha fixada é gravada no arquivo
+ * @param arq Arquivo aberto (buffer pool, vez de escrita com a thread atual)
+ * @param pos Número da folha
+ * @param fria true para gravá-la comprimida, false para gravá-la inteira
+ * @return true se a folha mudou
+ *
+ * A folha que muda entra no log como alterada, com a imagem sem
+ * compressão; por isso a forma comprimida só chega ao arquivo depois que
+ * o bloco do log está no disco, e uma gravação cortada por uma queda é
+ * refeita pelo log.
  */
-void imprimirEstrutura(fstream &arq) {
-    celula cab, l;
-    // Lê o cabeçalho
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
+bool marcarFria(arquivo &arq, int pos, bool fria) {
+    lock_guard<mutex> trava(arq.mCache);
+    int i = arq.tabela[pos];
+    if (arq.quadros[i].fria == fria) return false;
+    marcarPendente(arq, i);
+    arq.quadros[i].fria = fria;
+    return true;
+}
 
-    cout << "\n=== ESTRUTURA COMPLETA ==="
-         << "\nCabecalho:"
-         << "\n  Quant: " << cab.cabecalho.quant
-         << "\n  First: " << cab.cabecalho.first
-         << "\n  Last: " << cab.cabecalho.last
-         << "\n  Free: " << cab.cabecalho.free
-         << "\n  Tam: " << cab.cabecalho.tam
-         << "\n\nRegistros:";
+/**
+ * @brief Marca como frias, ou de volta como quentes, as folhas de um intervalo de chaves
+ * @param arq Arquivo aberto
+ * @param ini Menor chave do intervalo
+ * @param fim Maior chave do intervalo
+ * @param fria true para comprimir as folhas no arquivo, false para voltar a gravá-las inteiras
+ * @return Quantidade de folhas que mudaram
+ *
+ * O conteúdo das folhas não muda; só a forma como são gravadas
+ * (gravarQuadro). Lidas de novo, voltam a ser folhas comuns no buffer
+ * pool, e a primeira alteração as torna quentes outra vez. As folhas
+ * seguem o encadeamento a partir da primeira do intervalo; como na
+ * remoção por intervalo, um intervalo grande é confirmado em partes,
+ * descendo de novo a partir da folha seguinte. No arquivo mapeado não há
+ * compressão.
+ *
+ * Complexidade: O(log_B n + k) páginas lidas para k folhas no intervalo
+ */
+int esfriar(arquivo &arq, tipoChave ini, tipoChave fim, bool fria) {
+    if (arq.mapa) {
+        cout << "Erro: a compressao nao esta disponivel com --mmap.\n";
+        return 0;
+    }
+    int mudadas = 0;
+    iniciarEscrita(arq);
 
-    // Imprime todos os registros, um por um
-    for (int i = 1; i <= cab.cabecalho.tam; i++) {
-        arq.read((char*)&l, sizeof(l));
-        cout << "\n  Pos " << i << ": "
-             << "Chave=" << (l.lista.reg.chave == -1 ? "[LIVRE]" : to_string(l.lista.reg.chave))
-             << ", Nome=" << (l.lista.reg.chave == -1 ? "[LIVRE]" : l.lista.reg.nome)
-             << ", Next=" << l.lista.next
-             << ", Prev=" << l.lista.prev;
+    while (ini <= fim) {
+        caminho c;
+        int pos = descer(arq, ini, c);
+        soltarCaminho(arq, c);
+        pagina *l = c.folha;
+        bool parte = false;
+        while (true) {
+            int quant = l->folha.quant;
+            if (quant > 0 && l->folha.chave[0] <= fim && l->folha.chave[quant - 1] >= ini &&
+                marcarFria(arq, pos, fria)) {
+                mudadas++;
+                if (fria && !arq.cab.cabecalho.frias) {
+                    arq.cab.cabecalho.frias = 1;
+                    arq.cabSujo = true;
+                }
+            }
+            int proxima = l->folha.next;
+            bool continua = proxima != -1 && quant > 0 && l->folha.chave[quant - 1] < fim;
+            if (continua) ini = l->folha.chave[quant - 1] + 1;
+            desafixar(arq, pos, false);
+            if (!continua) break;
+            if (arq.alteradas.size() > arq.quadros.size() / 4) {
+                parte = true;
+                break;
+            }
+            pos = proxima;
+            l = fixar(arq, pos);
+        }
+        if (!parte) break;
+        confirmar(arq);
+        iniciarEscrita(arq);
     }
-    cout << "\n";
+    return mudadas;
 }
 
 /**
- * @brief Imprime apenas os registros válidos na ordem da lista
- * @param arq Referência para o arquivo já aberto
- * 
- * Percorre a lista de registros ativos seguindo os ponteiros next
- * a partir do primeiro registro (first) até o último (last).
- * 
- * Complexidade: O(n) onde n é o número de registros ativos
+ * @brief Monta o filtro de Bloom a partir das chaves de todas as folhas
+ * @param arq Arquivo aberto (sem escritas em andamento)
+ *
+ * Segue a lista de folhas; como no cursor, quando a próxima folha é a
+ * página vizinha, as LEITURA_ANTECIPADA seguintes são lidas de uma vez.
+ * O filtro novo é montado à parte e só então trocado pelo atual
+ * (trocarFiltro), então os leitores continuam usando o antigo enquanto
+ * isso.
+ *
+ * Complexidade: O(n/B) páginas lidas
  */
-void imprimirLista(fstream &arq) {
-    celula cab, l;
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
-
-    cout << "\n=== REGISTROS VALIDOS ==="
-         << "\nCabecalho:"
-         << "\n  Quant: " << cab.cabecalho.quant
-         << "\n  First: " << cab.cabecalho.first
-         << "\n  Last: " << cab.cabecalho.last
-         << "\n  Free: " << cab.cabecalho.free
-         << "\n\nRegistros:";
-
-    if (cab.cabecalho.first == -1) {
-        cout << "\nLista vazia!\n";
-        return;
+void construirFiltro(arquivo &arq) {
+    filtroBloom novo;
+    iniciarFiltro(novo, arq.cab.cabecalho.quant);
+    int antecipadas = 0;
+    int folha = arq.cab.cabecalho.first;
+    while (folha != -1) {
+        pagina *l = fixar(arq, folha);
+        for (int k = 0; k < l->folha.quant; k++) acrescentarFiltro(novo, l->folha.chave[k]);
+        int proxima = l->folha.next;
+        desafixar(arq, folha, false);
+        if (antecipadas > 0) {
+            antecipadas--;
+        } else if (proxima == folha + 1) {
+            anteciparPaginas(arq, proxima, LEITURA_ANTECIPADA);
+            antecipadas = LEITURA_ANTECIPADA;
+        }
+        folha = proxima;
     }
+    trocarFiltro(arq.filtro, novo);
+}
 
-    // Percorre a lista a partir do primeiro registro
-    int pos = cab.cabecalho.first;
-    while (pos != -1) {
-        arq.seekg(sizeof(celula) + (pos-1)*sizeof(celula), arq.beg);
-        arq.read((char*)&l, sizeof(l));
-        cout << "\n  Pos " << pos << ": "
-             << "Chave=" << l.lista.reg.chave
-             << " | Nome=" << l.lista.reg.nome
-             << " | Next=" << l.lista.next
-             << " | Prev=" << l.lista.prev;
-        
-        if (pos == cab.cabecalho.last) break;
-        pos = l.lista.next;
+/**
+ * @brief Volta a gravar inteiras todas as folhas frias do arquivo
+ * @param arq Arquivo recém-aberto, ainda sem o mapeamento
+ * @param log Caminho do log de escrita antecipada
+ * @return false se o log não pôde ser aberto
+ *
+ * Usada antes de mapear o arquivo em memória, que não tem onde expandir
+ * uma folha comprimida. O log é usado mesmo que a execução não vá usá-lo:
+ * as folhas são regravadas no lugar, e uma gravação cortada por uma queda
+ * precisa ser refeita.
+ */
+bool aquecerArquivo(arquivo &arq, const char *log) {
+    arq.fdLog = open(log, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (arq.fdLog == -1) {
+        cerr << "Erro: nao foi possivel abrir " << log << "!\n";
+        return false;
     }
-    cout << "\n";
+    int folhas = esfriar(arq, tracos::minimo(), tracos::maximo(), false);
+    arq.cab.cabecalho.frias = 0;
+    arq.cabSujo = true;
+    confirmar(arq);
+    iniciarEscrita(arq);
+    checkpoint(arq);
+    terminarEscrita(arq);
+    close(arq.fdLog);
+    arq.fdLog = -1;
+    if (folhas > 0) cout << folhas << " folha(s) fria(s) gravada(s) sem compressao para o mapeamento.\n";
+    return true;
 }
 
 /**
- * @brief Imprime a lista de nós livres
- * @param arq Referência para o arquivo já aberto
- * 
- * Percorre a lista de nós livres seguindo os ponteiros next
- * a partir do primeiro nó livre (free) até o final.
- * 
- * Complexidade: O(n) onde n é o número de nós livres
- */
-void imprimirFree(fstream &arq) {
-    celula cab, l;
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
-
-    cout << "\n=== REGISTROS LIVRES ==="
-         << "\nCabecalho:"
-         << "\n  Free: " << cab.cabecalho.free
-         << "\n\nRegistros livres:";
+ * @brief Abre um arquivo de dados já existente
+ * @param arq Arquivo a ser aberto
+ * @param dados Caminho do arquivo de dados
+ * @param log Caminho do log de escrita antecipada
+ * @param capacidade Quantidade de quadros do buffer pool
+ * @param usarMmap Se true, mapeia o arquivo em memória em vez de usar o cache
+ * @param usarLog Se true, as operações são confirmadas no log
+ * @return true se o arquivo está pronto para uso
+ *
+ * Reaplica o log deixado por uma execução interrompida, lê o cabeçalho
+ * para a memória, confere o formato e prepara o cache e o filtro de
+ * Bloom (lido do arquivo .flt ou refeito a partir das folhas). O log só é usado
+ * com o buffer pool: no arquivo mapeado o sistema pode gravar uma página
+ * a qualquer momento, antes do registro dela chegar ao log.
+ */
+bool abrirExistente(arquivo &arq, const char *dados, const char *log, int capacidade, bool usarMmap, bool usarLog) {
+    int reaplicados = recuperarLog(dados, log);
+    if (reaplicados > 0) {
+        cout << "Log: " << reaplicados << " operacao(oes) reaplicada(s).\n";
+    }
+    arq.f.open(dados, ios::binary | fstream::in | fstream::out);
+    if (!arq.f.is_open()) {
+        cerr << "Erro: nao foi possivel abrir " << dados << "!\n";
+        return false;
+    }
 
-    int pos = cab.cabecalho.free;
-    while (pos != -1) {
-        arq.seekg(sizeof(celula) + (pos-1)*sizeof(celula), arq.beg);
-        arq.read((char*)&l, sizeof(l));
-        cout << "\n  Pos " << pos << " -> Next: " << l.lista.next;
-        pos = l.lista.next;
+    // Carrega o cabeçalho e confere se o arquivo está no formato paginado
+    arq.f.seekg(0, arq.f.beg);
+    arq.f.read((char*)&arq.cab, sizeof(arq.cab.cabecalho));
+    if (!arq.f || arq.cab.cabecalho.assinatura != tracos::assinatura ||
+        !limiarValido(arq.cab.cabecalho.limiar, arq.cab.cabecalho.tamPagina)) {
+        cerr << "Erro: " << dados << " nao esta no formato paginado. Remova o arquivo para recria-lo.\n";
+        return false;
     }
-    cout << "\n";
+
+    // Arquivos anteriores à marca alto têm todas as páginas encadeadas
+    if (arq.cab.cabecalho.alto == 0) arq.cab.cabecalho.alto = arq.cab.cabecalho.tam;
+
+    iniciarCache(arq, capacidade);
+    arq.f.flush();
+    arq.fdDados = open(dados, O_RDWR);
+    if (arq.fdDados == -1) {
+        cerr << "Erro: nao foi possivel abrir " << dados << "!\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(arq.fdDados, &st) == 0) arq.blocoDisco = st.st_blksize;
+
+    // O arquivo mapeado lê as páginas como estão no disco
+    if (usarMmap && arq.cab.cabecalho.frias && !aquecerArquivo(arq, log)) return false;
+    if (usarMmap && !mapearArquivo(arq, dados)) {
+        cerr << "Erro: nao foi possivel mapear " << dados << ". Usando o cache.\n";
+    }
+    if (!arq.mapa) iniciarLeitor(arq.leitor, arq.fdDados);
+    if (usarLog && !arq.mapa) {
+        arq.fdLog = open(log, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (arq.fdLog == -1) {
+            cerr << "Erro: nao foi possivel abrir " << log << "!\n";
+            return false;
+        }
+    }
+
+    // O filtro gravado no último fechamento ou, se não há, um novo
+    arq.nomeFiltro = caminhoFiltro(dados);
+    if (!carregarFiltro(arq.filtro, arq.cab, arq.nomeFiltro.c_str())) construirFiltro(arq);
+    return true;
 }
 
 /**
- * @brief Pesquisa um registro pela chave
- * @param arq Referência para o arquivo já aberto
- * @param chave Chave a ser pesquisada
- * @param resultado Referência para armazenar o registro encontrado
- * @return true se encontrou, false caso contrário
- * 
- * Percorre a lista de registros ativos até encontrar a chave.
- * 
- * Complexidade: O(n) onde n é o número de registros ativos
+ * @brief Abre pagina.dat, criando-o se não existir
+ * @param arq Arquivo a ser aberto
+ * @param capacidade Quantidade de quadros do buffer pool
+ * @param usarMmap Se true, mapeia o arquivo em memória em vez de usar o cache
+ * @param usarLog Se true, as operações são confirmadas no log pagina.wal
+ * @param limiar Maior valor guardado na própria folha, se o arquivo for criado
+ * @return true se o arquivo está pronto para uso (abrirExistente)
  */
-bool pesquisa(fstream &arq, int chave, celula &resultado) {
-    celula cab;
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
+bool abrir(arquivo &arq, int capacidade, bool usarMmap, bool usarLog, int limiar) {
+    cout << "Abrindo arquivo pagina.dat...\n";
+    ifstream existe("pagina.dat", ios::binary);
 
-    int atual = cab.cabecalho.first;
-    while (atual != -1) {
-        arq.seekg(sizeof(celula) + (atual-1)*sizeof(celula), arq.beg);
-        arq.read((char*)&resultado, sizeof(resultado));
-        if (resultado.lista.reg.chave == chave) {
-            return true;
+    // Se arquivo não existe, cria um novo
+    if (!existe.is_open()) {
+        cout << "Arquivo nao existe. Criando novo...\n";
+        fstream novo("pagina.dat", ios::binary | fstream::in | fstream::out | fstream::trunc);
+        if (!novo.is_open()) {
+            cerr << "Erro ao criar arquivo!\n";
+            return false;
+        }
+        cout << "Digite o numero maximo de registros: ";
+        int n;
+        cin >> n;
+        cout << "Digite o tamanho da pagina (4096 ou 8192): ";
+        int tamPagina;
+        cin >> tamPagina;
+        if (tamPagina != 4096 && tamPagina != 8192) {
+            cout << "Tamanho invalido. Usando 4096.\n";
+            tamPagina = 4096;
+        }
+        if (!limiarValido(limiar, tamPagina)) {
+            cout << "Limiar invalido. Usando " << LIMIAR_PADRAO << ".\n";
+            limiar = LIMIAR_PADRAO;
         }
-        atual = resultado.lista.next;
+        remove("pagina.wal");  // Um log antigo não vale para o novo arquivo
+        remove("pagina.flt");
+        inicializar(novo, n, tamPagina, limiar);
     }
-    return false;
+    existe.close();
+    return abrirExistente(arq, "pagina.dat", "pagina.wal", capacidade, usarMmap, usarLog);
 }
 
 /**
- * @brief Insere um novo registro na primeira posição livre
- * @param arq Referência para o arquivo já aberto
- * @param d Dados a serem inseridos
- * 
- * Esta função:
- * 1. Verifica se a chave já existe
- * 2. Verifica se há espaço livre
- * 3. Insere no primeiro nó livre
- * 4. Atualiza os ponteiros e o cabeçalho
- * 
- * Complexidade: O(n) para pesquisa + O(1) para inserção
- */
-void inserir(fstream &arq, dados d) {
-    celula l, cab, existente;
-    
-    // Verifica se chave já existe
-    if (pesquisa(arq, d.chave, existente)) {
-        cout << "Erro: Chave ja existente!\n";
-        return;
+ * @brief Grava as páginas pendentes, esvazia o log e fecha o arquivo
+ * @param arq Arquivo aberto
+ *
+ * O filtro de Bloom é gravado depois do checkpoint, com o cabeçalho final.
+ */
+void fechar(arquivo &arq) {
+    confirmar(arq);
+    iniciarEscrita(arq);
+    checkpoint(arq);
+    terminarEscrita(arq);
+    if (!arq.nomeFiltro.empty()) gravarFiltro(arq.filtro, arq.cab, arq.nomeFiltro.c_str());
+    if (arq.fdLog != -1) {
+        close(arq.fdLog);
+        arq.fdLog = -1;
     }
+    encerrarLeitor(arq.leitor);
+    close(arq.fdDados);
+    arq.fdDados = -1;
+    if (arq.mapa) {
+        munmap(arq.mapa, arq.tamMapa);
+        close(arq.fd);
+        arq.mapa = NULL;
+    }
+    arq.f.close();
+}
 
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
+#define BUFFER_ROTEIRO (1 << 20)  ///< Bytes lidos de uma vez do arquivo de roteiro
 
-    // Verifica se há espaço livre
-    if (cab.cabecalho.free == -1) {
-        cout << "Erro: Arquivo cheio!\n";
-        return;
-    }
+/**
+ * @struct comandoBinario
+ * @brief Operação de um roteiro binário
+ *
+ * Cada operação é este cabeçalho seguido de tamNome bytes do nome (zero
+ * na remoção e na pesquisa). op usa as mesmas letras do roteiro em texto.
+ */
+struct comandoBinario {
+    int op;           ///< 'i', 'o', 'r', 'p', 's' ou 'x'
+    int tamNome;      ///< Bytes do nome que vêm depois do cabeçalho
+    tipoChave chave;  ///< Chave da operação
+};
+
+/**
+ * @struct medidaRoteiro
+ * @brief Latências e resultados de um tipo de operação do roteiro
+ */
+struct medidaRoteiro {
+    const char *nome;            ///< Nome da operação no resumo
+    vector<long long> latencias; ///< Duração de cada operação (ns)
+    long long efetivas;          ///< Operações que tiveram efeito (inseriu, removeu, achou)
+};
 
-    // Obtém o primeiro nó livre
-    arq.seekg(sizeof(celula) + (cab.cabecalho.free-1)*sizeof(celula), arq.beg);
-    arq.read((char*)&l, sizeof(l));
-    int free = l.lista.next;  // Salva o próximo livre
+/**
+ * @brief Lê a próxima operação de um roteiro
+ * @param f Arquivo do roteiro
+ * @param binario Se true, lê um comandoBinario; senão, uma linha de texto
+ * @param linha Buffer de linha reaproveitado entre as chamadas (getline)
+ * @param tam Tamanho alocado de linha
+ * @param op Recebe a letra da operação
+ * @param d Recebe a chave e o nome
+ * @return false no fim do roteiro
+ *
+ * Em texto, cada linha é "op chave [nome]", com o nome ocupando o resto
+ * da linha; linhas vazias ou começadas por '#' são ignoradas. Uma linha
+ * malformada, ou com uma chave que não cabe em tipoChave, é devolvida com
+ * op = '?'; no binário, também uma operação com nome maior que VALOR_MAX.
+ */
+bool lerComando(FILE *f, bool binario, char *&linha, size_t &tam, char &op, dados &d) {
+    if (binario) {
+        comandoBinario c;
+        if (fread(&c, sizeof(c), 1, f) != 1) return false;
+        op = (char)c.op;
+        d.chave = c.chave;
+        if (c.tamNome > VALOR_MAX) {
+            // Nome que nenhuma operação aceitaria: pula os bytes sem alocá-los
+            op = '?';
+            d.nome.clear();
+            return fseeko(f, c.tamNome, SEEK_CUR) == 0;
+        }
+        d.nome.resize(c.tamNome > 0 ? c.tamNome : 0);
+        return d.nome.empty() || fread(&d.nome[0], 1, d.nome.size(), f) == d.nome.size();
+    }
+    ssize_t lidos;
+    while ((lidos = getline(&linha, &tam, f)) != -1) {
+        while (lidos > 0 && (linha[lidos - 1] == '\n' || linha[lidos - 1] == '\r')) linha[--lidos] = 0;
+        char *p = linha;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == 0 || *p == '#') continue;
+        op = *p++;
+        char *fim;
+        if (!tracos::ler(p, fim, d.chave)) op = '?';
+        if (*fim == ' ' || *fim == '\t') fim++;
+        d.nome.assign(fim);
+        return true;
+    }
+    return false;
+}
 
-    // Configura o novo registro
-    l.lista.reg = d;
-    l.lista.next = -1;        // Será o último da lista
-    l.lista.prev = cab.cabecalho.last;  // Aponta para o antigo último
+/**
+ * @brief Imprime a linha de resumo de um tipo de operação
+ * @param m Medidas da operação (as latências são ordenadas)
+ */
+void imprimirMedida(medidaRoteiro &m) {
+    if (m.latencias.empty()) return;
+    sort(m.latencias.begin(), m.latencias.end());
+    size_t n = m.latencias.size();
+    double total = 0;
+    for (size_t k = 0; k < n; k++) total += m.latencias[k];
+    cout << "  " << m.nome << ": " << n << " op, " << m.efetivas << " efetiva(s)" << fixed << setprecision(2)
+         << " | media " << total / n / 1000 << " us"
+         << " | p50 " << m.latencias[(n - 1)*50/100] / 1000.0 << " us"
+         << " | p90 " << m.latencias[(n - 1)*90/100] / 1000.0 << " us"
+         << " | p99 " << m.latencias[(n - 1)*99/100] / 1000.0 << " us"
+         << " | max " << m.latencias[n - 1] / 1000.0 << " us\n";
+}
 
-    // Atualiza o antigo último registro
-    if (cab.cabecalho.last != -1) {
-        celula lastNode;
-        arq.seekg(sizeof(celula) + (cab.cabecalho.last-1)*sizeof(celula), arq.beg);
-        arq.read((char*)&lastNode, sizeof(lastNode));
-        lastNode.lista.next = cab.cabecalho.free;  // Aponta para o novo
-        arq.seekp(sizeof(celula) + (cab.cabecalho.last-1)*sizeof(celula), arq.beg);
-        arq.write((char*)&lastNode, sizeof(lastNode));
+/**
+ * @brief Executa um roteiro de operações sem o menu e resume o desempenho
+ * @param arq Arquivo aberto
+ * @param nome Arquivo do roteiro (".bin" para binário, senão texto)
+ * @return false se o roteiro não pôde ser aberto
+ *
+ * Operações: i (inserir), o (inserir ordenado), r (remover), p
+ * (pesquisar), s (inserir ou substituir) e x (remover pela localização).
+ * A remoção pela localização usa a devolvida pela última pesquisa ou
+ * substituição da mesma chave (removerReferencia), sem descer pelo
+ * índice; sem ela, remove pela chave. Cada operação que altera o
+ * arquivo é confirmada, como no menu, e a latência medida inclui a
+ * confirmação. O roteiro é lido com um buffer de BUFFER_ROTEIRO bytes e,
+ * durante a execução, as mensagens das operações (como "Chave ja
+ * existente") são descartadas: só o resumo é impresso, com a vazão total
+ * e os percentis de latência de cada tipo de operação.
+ *
+ * Complexidade: O(k log k) para k operações, além das próprias operações
+ */
+bool executarRoteiro(arquivo &arq, const char *nome) {
+    string s = nome;
+    bool binario = s.size() >= 4 && s.compare(s.size() - 4, 4, ".bin") == 0;
+    FILE *f = fopen(nome, binario ? "rb" : "r");
+    if (!f) {
+        cout << "Erro: nao foi possivel abrir " << nome << "!\n";
+        return false;
     }
+    setvbuf(f, NULL, _IOFBF, BUFFER_ROTEIRO);
 
-    // Escreve o novo registro
-    arq.seekp(sizeof(celula) + (cab.cabecalho.free-1)*sizeof(celula), arq.beg);
-    arq.write((char*)&l, sizeof(l));
+    medidaRoteiro insercao = {"inserir", {}, 0}, ordenado = {"inserir ordenado", {}, 0},
+                  remocao = {"remover", {}, 0}, busca = {"pesquisar", {}, 0},
+                  substituicao = {"inserir ou substituir", {}, 0},
+                  removerLocal = {"remover pela localizacao", {}, 0};
+    long long invalidas = 0;
+    referencia local = {-1, 0, 0};  // Localização da última pesquisa ou substituição
+    char *linha = NULL;
+    size_t tam = 0;
+    char op;
+    dados d, resultado;
 
-    // Atualiza cabeçalho
-    if (cab.cabecalho.first == -1) {
-        cab.cabecalho.first = cab.cabecalho.free;  // Primeiro registro
+    cout.setstate(ios::failbit);
+    chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+    while (lerComando(f, binario, linha, tam, op, d)) {
+        medidaRoteiro *m;
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        bool efetiva;
+        if (op == 'i' || op == 'o') {
+            int antes = arq.cab.cabecalho.quant;
+            if (op == 'i') inserir(arq, d);
+            else inserirOrdenado(arq, d);
+            confirmar(arq);
+            efetiva = arq.cab.cabecalho.quant > antes;
+            m = op == 'i' ? &insercao : &ordenado;
+        } else if (op == 'r') {
+            efetiva = remover(arq, d.chave);
+            confirmar(arq);
+            m = &remocao;
+        } else if (op == 'p') {
+            efetiva = pesquisa(arq, d.chave, resultado, &local);
+            m = &busca;
+        } else if (op == 's') {
+            efetiva = gravarRegistro(arq, d, true, &local) >= 0;
+            confirmar(arq);
+            m = &substituicao;
+        } else if (op == 'x') {
+            if (local.chave != d.chave) local = referencia{-1, 0, d.chave};
+            efetiva = removerReferencia(arq, local);
+            confirmar(arq);
+            m = &removerLocal;
+        } else {
+            invalidas++;
+            continue;
+        }
+        m->latencias.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count());
+        if (efetiva) m->efetivas++;
     }
-    
-    cab.cabecalho.last = cab.cabecalho.free;  // Novo último
-    cab.cabecalho.free = free;                // Atualiza lista livre
-    cab.cabecalho.quant++;                    // Incrementa contador
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    cout.clear();
+    free(linha);
+    fclose(f);
 
-    // Escreve cabeçalho atualizado
-    arq.seekp(0, arq.beg);
-    arq.write((char*)&cab, sizeof(cab));
+    size_t total = insercao.latencias.size() + ordenado.latencias.size() + remocao.latencias.size() +
+                   busca.latencias.size() + substituicao.latencias.size() + removerLocal.latencias.size();
+    cout << "Roteiro: " << total << " operacao(oes) em " << fixed << setprecision(3) << segundos << " s ("
+         << setprecision(0) << (segundos > 0 ? total / segundos : 0.0) << " op/s)\n";
+    imprimirMedida(insercao);
+    imprimirMedida(ordenado);
+    imprimirMedida(remocao);
+    imprimirMedida(busca);
+    imprimirMedida(substituicao);
+    imprimirMedida(removerLocal);
+    if (invalidas > 0) cout << "  " << invalidas << " linha(s) invalida(s) ignorada(s)\n";
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    return true;
 }
 
+#define OPERACOES_MEDIDA 10000  ///< Operações medidas em cada carga de trabalho, por padrão
+#define TETA_ZIPF 0.99          ///< Assimetria da distribuição de Zipf (a mesma do YCSB)
+#define VARREDURA_MAX 100       ///< Maior quantidade de registros de uma varredura curta
+#define SEMENTE_MEDIDA 42       ///< Semente fixa: todas as execuções sorteiam as mesmas chaves
+
+#define CHAVES_SEQUENCIAIS 0    ///< Chaves em ordem crescente
+#define CHAVES_UNIFORMES 1      ///< Chaves em ordem aleatória, sem repetição
+#define CHAVES_ZIPF 2           ///< Poucas chaves muito acessadas, espalhadas pelo arquivo
+#define CHAVES_RECENTES 3       ///< Chaves mais novas mais acessadas; inserções acima da maior
+
 /**
- * @brief Insere um novo registro mantendo a ordenação por chave
- * @param arq Referência para o arquivo já aberto
- * @param d Dados a serem inseridos
- * 
- * Esta função:
- * 1. Verifica se a chave já existe
- * 2. Encontra a posição correta para manter a ordenação
- * 3. Atualiza os ponteiros dos nós vizinhos
- * 4. Atualiza o cabeçalho
- * 
- * Complexidade: O(n) onde n é o número de registros ativos
+ * @struct zipf
+ * @brief Gerador de postos com distribuição de Zipf (Gray et al., o do YCSB)
+ *
+ * O posto 0 é o mais frequente. zetan custa O(n) e é calculado uma vez
+ * por tamanho de arquivo.
  */
-void inserirOrdenado(fstream &arq, dados d) {
-    celula cab, l, novo, existente;
-    
-    // Verifica se chave já existe
-    if (pesquisa(arq, d.chave, existente)) {
-        cout << "Erro: Chave ja existente!\n";
-        return;
-    }
+struct zipf {
+    long long n;    ///< Quantidade de postos
+    double alfa;    ///< 1/(1 - teta)
+    double zetan;   ///< Soma de 1/i^teta para i de 1 a n
+    double eta;     ///< Constante da inversão
+    double limite;  ///< 1 + 0.5^teta (fronteira entre os postos 1 e 2)
+};
 
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
+/**
+ * @brief Prepara o gerador de Zipf para n postos
+ */
+void iniciarZipf(zipf &z, long long n) {
+    double zeta2 = 1 + pow(0.5, TETA_ZIPF);
+    z.n = n;
+    z.zetan = 0;
+    for (long long i = 1; i <= n; i++) z.zetan += 1 / pow((double)i, TETA_ZIPF);
+    z.alfa = 1 / (1 - TETA_ZIPF);
+    z.eta = (1 - pow(2.0 / n, 1 - TETA_ZIPF)) / (1 - zeta2 / z.zetan);
+    z.limite = zeta2;
+}
 
-    // Verifica se há espaço livre
-    if (cab.cabecalho.free == -1) {
-        cout << "Erro: Arquivo cheio!\n";
-        return;
-    }
+/**
+ * @brief Sorteia um posto de 0 a n-1
+ */
+long long sortearZipf(const zipf &z, mt19937_64 &g) {
+    double u = uniform_real_distribution<double>(0, 1)(g);
+    double uz = u*z.zetan;
+    if (uz < 1) return 0;
+    if (uz < z.limite) return 1;
+    long long posto = (long long)(z.n*pow(z.eta*u - z.eta + 1, z.alfa));
+    return std::min(posto, z.n - 1);
+}
 
-    // Obtém o primeiro nó livre
-    arq.seekg(sizeof(celula) + (cab.cabecalho.free-1)*sizeof(celula), arq.beg);
-    arq.read((char*)&novo, sizeof(novo));
-    int free = novo.lista.next;  // Salva o próximo livre
+/**
+ * @struct cargaTrabalho
+ * @brief Mistura de operações de uma carga de trabalho medida
+ *
+ * As porcentagens somam 100. As chaves existentes são as pares 0, 2, 4,
+ * ...; as inserções CHAVES_SEQUENCIAIS e CHAVES_UNIFORMES usam as ímpares
+ * (entre as existentes) e as CHAVES_RECENTES vêm acima da maior chave.
+ */
+struct cargaTrabalho {
+    const char *nome;  ///< Nome no resumo
+    int pesquisa;      ///< % de pesquisas
+    int atualizacao;   ///< % de substituições do nome
+    int insercao;      ///< % de inserções
+    int varredura;     ///< % de varreduras curtas (1 a VARREDURA_MAX registros)
+    int lerModificar;  ///< % de pesquisas seguidas da substituição do nome
+    int remocao;       ///< % de remoções
+    int existentes;    ///< Sorteio das chaves existentes (CHAVES_*)
+    int novas;         ///< Sorteio das chaves inseridas (CHAVES_*)
+    bool ordenada;     ///< Inserções por inserirOrdenado em vez de inserir
+};
 
-    // Configura o novo nó
-    novo.lista.reg = d;
-    novo.lista.next = -1;
-    novo.lista.prev = -1;
+/**
+ * @struct configuracaoMedida
+ * @brief Opções de linha de comando usadas pelas medidas
+ */
+struct configuracaoMedida {
+    int capacidade;     ///< Quadros do buffer pool
+    bool usarMmap;      ///< Arquivo mapeado em memória
+    bool usarLog;       ///< Confirmação no log
+    int tamPagina;      ///< Tamanho da página
+    int preenchimento;  ///< Ocupação das folhas na carga inicial (%)
+    int limiar;         ///< Maior valor guardado na folha
+    int alocacao;       ///< Política de alocação
+    int operacoes;      ///< Operações medidas por carga de trabalho
+};
 
-    // Caso lista vazia
-    if (cab.cabecalho.first == -1) {
-        cab.cabecalho.first = cab.cabecalho.free;
-        cab.cabecalho.last = cab.cabecalho.free;
-    } else {
-        // Procura posição de inserção
-        int atual = cab.cabecalho.first;
-        int anterior_pos = -1;
-
-        while (atual != -1) {
-            arq.seekg(sizeof(celula) + (atual-1)*sizeof(celula), arq.beg);
-            arq.read((char*)&l, sizeof(l));
-            if (l.lista.reg.chave > d.chave) break;
-            anterior_pos = atual;
-            atual = l.lista.next;
-        }
-
-        // Inserção no início
-        if (atual == cab.cabecalho.first) {
-            novo.lista.next = cab.cabecalho.first;
-            novo.lista.prev = -1;
-            
-            // Atualiza o antigo primeiro
-            arq.seekg(sizeof(celula) + (cab.cabecalho.first-1)*sizeof(celula), arq.beg);
-            arq.read((char*)&l, sizeof(l));
-            l.lista.prev = cab.cabecalho.free;
-            arq.seekp(sizeof(celula) + (cab.cabecalho.first-1)*sizeof(celula), arq.beg);
-            arq.write((char*)&l, sizeof(l));
-            
-            cab.cabecalho.first = cab.cabecalho.free;
-        } 
-        // Inserção no final
-        else if (atual == -1) {
-            novo.lista.prev = cab.cabecalho.last;
-            
-            // Atualiza o antigo último
-            arq.seekg(sizeof(celula) + (cab.cabecalho.last-1)*sizeof(celula), arq.beg);
-            arq.read((char*)&l, sizeof(l));
-            l.lista.next = cab.cabecalho.free;
-            arq.seekp(sizeof(celula) + (cab.cabecalho.last-1)*sizeof(celula), arq.beg);
-            arq.write((char*)&l, sizeof(l));
-            
-            cab.cabecalho.last = cab.cabecalho.free;
-        }
-        // Inserção no meio
-        else {
-            celula anterior, proximo;
-            novo.lista.prev = anterior_pos;
-            novo.lista.next = atual;
-
-            // Atualiza nó anterior
-            arq.seekg(sizeof(celula) + (anterior_pos-1)*sizeof(celula), arq.beg);
-            arq.read((char*)&anterior, sizeof(anterior));
-            anterior.lista.next = cab.cabecalho.free;
-            arq.seekp(sizeof(celula) + (anterior_pos-1)*sizeof(celula), arq.beg);
-            arq.write((char*)&anterior, sizeof(anterior));
-
-            // Atualiza nó posterior
-            arq.seekg(sizeof(celula) + (atual-1)*sizeof(celula), arq.beg);
-            arq.read((char*)&proximo, sizeof(proximo));
-            proximo.lista.prev = cab.cabecalho.free;
-            arq.seekp(sizeof(celula) + (atual-1)*sizeof(celula), arq.beg);
-            arq.write((char*)&proximo, sizeof(proximo));
-        }
-    }
-
-    // Escreve o novo nó
-    arq.seekp(sizeof(celula) + (cab.cabecalho.free-1)*sizeof(celula), arq.beg);
-    arq.write((char*)&novo, sizeof(novo));
+/**
+ * @brief Nome de 29 bytes gravado na chave pelas medidas
+ * @param chave Chave do registro
+ * @param alterado Se true, o nome usado nas substituições (mesmo tamanho)
+ */
+string valorMedida(tipoChave chave, bool alterado) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s-%020lld", alterado ? "alterado" : "registro", (long long)chave);
+    return buf;
+}
 
-    // Atualiza cabeçalho
-    cab.cabecalho.free = free;
-    cab.cabecalho.quant++;
-    arq.seekp(0, arq.beg);
-    arq.write((char*)&cab, sizeof(cab));
+/**
+ * @brief Tira as páginas de um arquivo do cache do sistema operacional
+ * @param nome Caminho do arquivo
+ *
+ * As páginas sujas são gravadas antes, já que o sistema só descarta
+ * páginas limpas.
+ */
+void esfriarArquivo(const char *nome) {
+    int fd = open(nome, O_RDONLY);
+    if (fd == -1) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
 }
 
 /**
- * @brief Remove um registro pela chave
- * @param arq Referência para o arquivo já aberto
- * @param chave Chave do registro a ser removido
- * @return true se removeu com sucesso, false se não encontrou
- * 
- * Esta função:
- * 1. Localiza o registro a ser removido
- * 2. Atualiza os ponteiros dos nós vizinhos
- * 3. Adiciona o nó removido à lista de livres
- * 4. Atualiza o cabeçalho
- * 
- * Complexidade: O(n) onde n é o número de registros ativos
+ * @brief Mede uma carga de trabalho em um arquivo recém-construído
+ * @param c Carga de trabalho
+ * @param n Registros carregados antes da medida
+ * @param frio Se true, começa sem páginas no cache (buffer pool e sistema)
+ * @param cfg Opções da medida
+ * @param z Gerador de Zipf para n postos
+ * @param permutacao Os números de 0 a n-1 embaralhados
+ * @return false se o arquivo não pôde ser construído ou aberto
+ *
+ * O arquivo medida.dat é construído por carregarOrdenado a partir de
+ * medida.bin a cada carga, para que as cargas que alteram o arquivo não
+ * afetem as seguintes. No cache quente, todas as folhas são percorridas
+ * por um cursor antes da medida. Cada operação de escrita é confirmada,
+ * como no menu. A vazão e as latências cobrem só as operações; os bytes
+ * incluem o fechamento, que grava as páginas que o buffer pool ainda
+ * guardava. No arquivo mapeado, as leituras são faltas de página e não
+ * aparecem nos bytes lidos, e as gravações contam o intervalo inteiro
+ * passado ao msync.
  */
-bool remover(fstream &arq, int chave) {
-    celula cab, l;
-    arq.seekg(0, arq.beg);
-    arq.read((char*)&cab, sizeof(cab));
+bool medirCarga(const cargaTrabalho &c, long long n, bool frio, const configuracaoMedida &cfg,
+                const zipf &z, const vector<int> &permutacao) {
+    // As mensagens da carga e das operações são descartadas
+    cout.setstate(ios::failbit);
+    if (!carregarOrdenado("medida.bin", "medida.dat", "medida.wal", cfg.tamPagina, cfg.preenchimento,
+                          n + cfg.operacoes, cfg.limiar)) {
+        cout.clear();
+        cout << "Erro: nao foi possivel construir medida.dat!\n";
+        return false;
+    }
+    if (frio) esfriarArquivo("medida.dat");
+    arquivo arq;
+    if (!abrirExistente(arq, "medida.dat", "medida.wal", cfg.capacidade, cfg.usarMmap, cfg.usarLog)) {
+        cout.clear();
+        return false;
+    }
+    arq.alocacao = cfg.alocacao;
 
-    int atual = cab.cabecalho.first;
-    int anterior_pos = -1;
+    dados d, resultado;
+    if (!frio) {
+        cursor cur;
+        posicionar(arq, cur, tracos::minimo(), tracos::maximo());
+        while (proximo(arq, cur, resultado)) {}
+        arq.bytesLidos.store(0);
+        arq.bytesGravados.store(0);
+    }
 
-    // Procura o registro
-    while (atual != -1) {
-        arq.seekg(sizeof(celula) + (atual-1)*sizeof(celula), arq.beg);
-        arq.read((char*)&l, sizeof(l));
-        
-        if (l.lista.reg.chave == chave) {
-            // Atualiza nó anterior
-            if (l.lista.prev != -1) {
-                celula anterior;
-                arq.seekg(sizeof(celula) + (l.lista.prev-1)*sizeof(celula), arq.beg);
-                arq.read((char*)&anterior, sizeof(anterior));
-                anterior.lista.next = l.lista.next;
-                arq.seekp(sizeof(celula) + (l.lista.prev-1)*sizeof(celula), arq.beg);
-                arq.write((char*)&anterior, sizeof(anterior));
-            } else {
-                // Era o primeiro - atualiza cabeçalho
-                cab.cabecalho.first = l.lista.next;
-            }
-
-            // Atualiza nó posterior
-            if (l.lista.next != -1) {
-                celula proximo;
-                arq.seekg(sizeof(celula) + (l.lista.next-1)*sizeof(celula), arq.beg);
-                arq.read((char*)&proximo, sizeof(proximo));
-                proximo.lista.prev = l.lista.prev;
-                arq.seekp(sizeof(celula) + (l.lista.next-1)*sizeof(celula), arq.beg);
-                arq.write((char*)&proximo, sizeof(proximo));
-            } else {
-                // Era o último - atualiza cabeçalho
-                cab.cabecalho.last = l.lista.prev;
-            }
+    mt19937_64 g(SEMENTE_MEDIDA);
+    vector<long long> latencias;
+    latencias.reserve(cfg.operacoes);
+    long long total = n;  // Chaves pares 0, 2, ..., 2*(total-1) já usadas
+    long long ordem = 0;  // Próxima posição nas sequências sem repetição
+    long long novas = 0;  // Próxima chave ímpar inserida
+    chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+    for (int k = 0; k < cfg.operacoes; k++) {
+        int sorteio = uniform_int_distribution<int>(0, 99)(g);
+        long long indice;
+        if (c.existentes == CHAVES_SEQUENCIAIS) indice = ordem++ % n;
+        else if (c.existentes == CHAVES_UNIFORMES) indice = permutacao[ordem++ % n];
+        else if (c.existentes == CHAVES_ZIPF) {
+            // Espalha os postos para que as chaves quentes não fiquem na mesma folha
+            long long posto = sortearZipf(z, g);
+            indice = somaFnv((const char*)&posto, sizeof(posto)) % n;
+        } else indice = std::max(0LL, total - 1 - sortearZipf(z, g));
+        d.chave = (tipoChave)(2*indice);
 
-            // Libera o nó
-            l.lista.next = cab.cabecalho.free;
-            l.lista.prev = -1;
-            l.lista.reg.chave = -1;  // Marca como livre
-            strcpy(l.lista.reg.nome, "[LIVRE]");
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        if ((sorteio -= c.pesquisa) < 0) {
+            pesquisa(arq, d.chave, resultado);
+        } else if ((sorteio -= c.atualizacao) < 0) {
+            d.nome = valorMedida(d.chave, true);
+            gravarRegistro(arq, d, true);
+            confirmar(arq);
+        } else if ((sorteio -= c.insercao) < 0) {
+            if (c.novas == CHAVES_SEQUENCIAIS) d.chave = (tipoChave)(2*(novas++ % n) + 1);
+            else if (c.novas == CHAVES_UNIFORMES) d.chave = (tipoChave)(2*permutacao[novas++ % n] + 1);
+            else d.chave = (tipoChave)(2*total++);
+            d.nome = valorMedida(d.chave, false);
+            if (c.ordenada) inserirOrdenado(arq, d);
+            else inserir(arq, d);
+            confirmar(arq);
+        } else if ((sorteio -= c.varredura) < 0) {
+            int quant = uniform_int_distribution<int>(1, VARREDURA_MAX)(g);
+            cursor cur;
+            posicionar(arq, cur, d.chave, tracos::maximo());
+            while (quant-- > 0 && proximo(arq, cur, resultado)) {}
+        } else if ((sorteio -= c.lerModificar) < 0) {
+            pesquisa(arq, d.chave, resultado);
+            d.nome = valorMedida(d.chave, true);
+            gravarRegistro(arq, d, true);
+            confirmar(arq);
+        } else {
+            remover(arq, d.chave);
+            confirmar(arq);
+        }
+        latencias.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count());
+    }
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    fechar(arq);
+    cout.clear();
 
-            // Escreve nó liberado
-            arq.seekp(sizeof(celula) + (atual-1)*sizeof(celula), arq.beg);
-            arq.write((char*)&l, sizeof(l));
+    sort(latencias.begin(), latencias.end());
+    size_t m = latencias.size();
+    cout << "  " << (frio ? "frio   " : "quente ") << left << setw(22) << c.nome << right << fixed
+         << setprecision(0) << setw(10) << (segundos > 0 ? m / segundos : 0.0) << " op/s" << setprecision(2)
+         << " | p50 " << setw(8) << latencias[(m - 1)*50/100] / 1000.0 << " us"
+         << " | p99 " << setw(8) << latencias[(m - 1)*99/100] / 1000.0 << " us" << setprecision(1)
+         << " | lidos " << setw(8) << (double)arq.bytesLidos.load() / m << " B/op"
+         << " | gravados " << setw(8) << (double)arq.bytesGravados.load() / m << " B/op\n";
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    return true;
+}
 
-            // Atualiza lista de livres
-            cab.cabecalho.free = atual;
-            cab.cabecalho.quant--;
+/**
+ * @brief Executa todas as cargas de trabalho em arquivos de vários tamanhos
+ * @param tamanhos Quantidades de registros separadas por vírgula (ex.: "10000,100000")
+ * @param cfg Opções da medida
+ * @return false se alguma medida falhou
+ *
+ * Para cada tamanho n grava medida.bin com as chaves pares de 0 a 2(n-1)
+ * e mede, com o cache frio e depois quente: pesquisas sequenciais,
+ * uniformes e de Zipf; inserções sequenciais, aleatórias e pelo fim com
+ * inserirOrdenado; remoções sequenciais e aleatórias; e as cargas A a F
+ * do YCSB (A: 50% pesquisa e 50% substituição; B: 95/5; C: só pesquisa;
+ * D: 95% pesquisa das chaves recentes e 5% inserção; E: 95% varredura
+ * curta e 5% inserção; F: 50% pesquisa e 50% leitura seguida de
+ * substituição). Os arquivos medida.* são removidos no fim.
+ *
+ * Complexidade: O(n) por carga para construir o arquivo, além das operações
+ */
+bool executarMedidas(const char *tamanhos, const configuracaoMedida &cfg) {
+    static const cargaTrabalho cargas[] = {
+        {"pesquisar sequencial", 100, 0, 0, 0, 0, 0, CHAVES_SEQUENCIAIS, CHAVES_SEQUENCIAIS, false},
+        {"pesquisar uniforme", 100, 0, 0, 0, 0, 0, CHAVES_UNIFORMES, CHAVES_SEQUENCIAIS, false},
+        {"pesquisar zipf", 100, 0, 0, 0, 0, 0, CHAVES_ZIPF, CHAVES_SEQUENCIAIS, false},
+        {"inserir sequencial", 0, 0, 100, 0, 0, 0, CHAVES_SEQUENCIAIS, CHAVES_SEQUENCIAIS, false},
+        {"inserir aleatorio", 0, 0, 100, 0, 0, 0, CHAVES_SEQUENCIAIS, CHAVES_UNIFORMES, false},
+        {"inserir ordenado", 0, 0, 100, 0, 0, 0, CHAVES_SEQUENCIAIS, CHAVES_RECENTES, true},
+        {"remover sequencial", 0, 0, 0, 0, 0, 100, CHAVES_SEQUENCIAIS, CHAVES_SEQUENCIAIS, false},
+        {"remover aleatorio", 0, 0, 0, 0, 0, 100, CHAVES_UNIFORMES, CHAVES_SEQUENCIAIS, false},
+        {"ycsb a", 50, 50, 0, 0, 0, 0, CHAVES_ZIPF, CHAVES_RECENTES, false},
+        {"ycsb b", 95, 5, 0, 0, 0, 0, CHAVES_ZIPF, CHAVES_RECENTES, false},
+        {"ycsb c", 100, 0, 0, 0, 0, 0, CHAVES_ZIPF, CHAVES_RECENTES, false},
+        {"ycsb d", 95, 0, 5, 0, 0, 0, CHAVES_RECENTES, CHAVES_RECENTES, false},
+        {"ycsb e", 0, 0, 5, 95, 0, 0, CHAVES_ZIPF, CHAVES_RECENTES, false},
+        {"ycsb f", 50, 0, 0, 0, 50, 0, CHAVES_ZIPF, CHAVES_RECENTES, false},
+    };
 
-            // Se lista ficou vazia
-            if (cab.cabecalho.quant == 0) {
-                cab.cabecalho.first = -1;
-                cab.cabecalho.last = -1;
-            }
+    bool ok = true;
+    for (const char *p = tamanhos; *p && ok; ) {
+        char *fim;
+        long long n = strtoll(p, &fim, 10);
+        if (fim == p || n <= 0) {
+            cout << "Erro: tamanho invalido em --medir: " << p << "\n";
+            return false;
+        }
+        p = *fim == ',' ? fim + 1 : fim;
 
-            // Atualiza cabeçalho
-            arq.seekp(0, arq.beg);
-            arq.write((char*)&cab, sizeof(cab));
-            return true;
+        // Entrada da carga inicial, no formato binário de carregarOrdenado
+        FILE *f = fopen("medida.bin", "wb");
+        if (!f) {
+            cout << "Erro: nao foi possivel criar medida.bin!\n";
+            return false;
+        }
+        setvbuf(f, NULL, _IOFBF, BUFFER_ROTEIRO);
+        for (long long i = 0; i < n; i++) {
+            registroBinario r;
+            memset(&r, 0, sizeof(r));
+            r.chave = (tipoChave)(2*i);
+            string nome = valorMedida(r.chave, false);
+            memcpy(r.nome, nome.data(), nome.size());
+            fwrite(&r, sizeof(r), 1, f);
+        }
+        fclose(f);
+
+        zipf z;
+        iniciarZipf(z, n);
+        vector<int> permutacao(n);
+        for (long long i = 0; i < n; i++) permutacao[i] = (int)i;
+        mt19937_64 g(SEMENTE_MEDIDA);
+        shuffle(permutacao.begin(), permutacao.end(), g);
+
+        cout << "Medida: " << n << " registro(s), " << cfg.operacoes << " operacao(oes) por carga, pagina "
+             << cfg.tamPagina << ", " << (cfg.usarMmap ? "mmap" : to_string(cfg.capacidade) + " quadro(s)")
+             << (cfg.usarLog && !cfg.usarMmap ? ", com log" : ", sem log") << "\n";
+        for (const cargaTrabalho &c : cargas) {
+            if (!(ok = medirCarga(c, n, true, cfg, z, permutacao) &&
+                       medirCarga(c, n, false, cfg, z, permutacao))) break;
         }
-        anterior_pos = atual;
-        atual = l.lista.next;
     }
-    return false;
+    remove("medida.bin");
+    remove("medida.dat");
+    remove("medida.wal");
+    remove("medida.flt");
+    return ok;
 }
 
 /**
  * @brief Função principal
- * 
+ * @param argc Quantidade de argumentos
+ * @param argv Argumentos: opcionalmente --quadros N (capacidade do cache)
+ *             e --mmap (arquivo mapeado em memória); --sem-log desliga o
+ *             log de escrita antecipada; --sem-io-uring lê os lotes de
+ *             páginas com threads em vez do io_uring; --carregar ENTRADA
+ *             constrói pagina.dat a partir de registros ordenados, com
+ *             --preenchimento P, --registros N e --pagina T opcionais;
+ *             --alocacao endereco escolhe páginas livres perto das vizinhas;
+ *             --limiar N define, para um arquivo novo, o maior nome
+ *             guardado na própria folha; --roteiro ARQUIVO executa as
+ *             operações do arquivo no lugar do menu (executarRoteiro);
+ *             --medir TAMANHOS mede as cargas de trabalho em arquivos
+ *             temporários (executarMedidas), com --operacoes K por carga;
+ *             --estatisticas json|prometheus imprime os contadores de
+ *             instrumentação ao fechar (compilado com -DESTATISTICAS);
+ *             --threads N define os trabalhadores de Agregar intervalo
+ *             (por padrão, um por processador)
+ *
  * Responsável por:
  * - Abrir/criar o arquivo de dados
  * - Exibir menu interativo
  * - Chamar as operações conforme seleção do usuário
- * 
+ *
  * Menu de opções:
  * 1. Inserir registro
  * 2. Inserir ordenado
@@ -527,30 +7082,104 @@ bool remover(fstream &arq, int chave) {
  * 4. Pesquisar registro
  * 5. Imprimir registros válidos
  * 6. Imprimir estrutura completa
- * 7. Imprimir nós livres
+ * 7. Imprimir páginas livres
+ * 8. Imprimir índice
+ * 9. Inserir lote
+ * 10. Inserir ou substituir
+ * 11. Pesquisar intervalo
+ * 12. Remover intervalo
+ * 13. Compactar
+ * 14. Pesquisar lote
+ * 15. Comprimir intervalo
+ * 16. Agregar intervalo
  * 0. Sair
  */
-int main() {
-    fstream arq;
+int main(int argc, char *argv[]) {
+    arquivo arq;
     dados d;
-    int op, chave;
-    celula resultado;
+    int op;
+    tipoChave chave;
+    dados resultado;
 
-    cout << "Abrindo arquivo pagina.dat...\n";
-    arq.open("pagina.dat", ios::binary | fstream::in | fstream::out);
-    
-    // Se arquivo não existe, cria um novo
-    if (!arq.is_open()) {
-        cout << "Arquivo nao existe. Criando novo...\n";
-        arq.open("pagina.dat", ios::binary | fstream::in | fstream::out | fstream::trunc);
-        if (!arq.is_open()) {
-            cerr << "Erro ao criar arquivo!\n";
-            return 1;
+    int quadros = QUADROS_PADRAO;
+    bool usarMmap = false, usarLog = true;
+    const char *carga = NULL;
+    int preenchimento = 100, registros = 0, tamPagina = 4096;
+    int alocacao = ALOCACAO_PILHA;
+    int limiar = LIMIAR_PADRAO;
+    const char *roteiro = NULL;
+    const char *medir = NULL;
+    int operacoes = OPERACOES_MEDIDA;
+    const char *formatoEstat = NULL;
+    int threads = thread::hardware_concurrency();
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--quadros") == 0 && a + 1 < argc) quadros = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--mmap") == 0) usarMmap = true;
+        else if (strcmp(argv[a], "--sem-log") == 0) usarLog = false;
+        else if (strcmp(argv[a], "--sem-io-uring") == 0) permitirIoUring = false;
+        else if (strcmp(argv[a], "--carregar") == 0 && a + 1 < argc) carga = argv[++a];
+        else if (strcmp(argv[a], "--preenchimento") == 0 && a + 1 < argc) preenchimento = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--registros") == 0 && a + 1 < argc) registros = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--pagina") == 0 && a + 1 < argc) tamPagina = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--limiar") == 0 && a + 1 < argc) limiar = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--roteiro") == 0 && a + 1 < argc) roteiro = argv[++a];
+        else if (strcmp(argv[a], "--medir") == 0 && a + 1 < argc) medir = argv[++a];
+        else if (strcmp(argv[a], "--operacoes") == 0 && a + 1 < argc) operacoes = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--estatisticas") == 0 && a + 1 < argc) {
+            formatoEstat = argv[++a];
+            if (strcmp(formatoEstat, "json") != 0 && strcmp(formatoEstat, "prometheus") != 0) {
+                cout << "Formato de estatisticas invalido. Usando json.\n";
+                formatoEstat = "json";
+            }
+#ifndef ESTATISTICAS
+            cout << "Aviso: contadores desligados nesta compilacao (use -DESTATISTICAS).\n";
+#endif
         }
-        cout << "Digite o numero maximo de registros: ";
-        int n;
-        cin >> n;
-        inicializar(arq, n);
+        else if (strcmp(argv[a], "--alocacao") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "endereco") == 0) alocacao = ALOCACAO_ENDERECO;
+            else if (strcmp(argv[a], "pilha") == 0) alocacao = ALOCACAO_PILHA;
+            else cout << "Politica de alocacao invalida. Usando pilha.\n";
+        }
+    }
+
+    // Sem carga nem medida, o tamanho e o limiar são conferidos na criação
+    if (carga || medir) {
+        if (tamPagina != 4096 && tamPagina != 8192) {
+            cout << "Tamanho invalido. Usando 4096.\n";
+            tamPagina = 4096;
+        }
+        if (!limiarValido(limiar, tamPagina)) {
+            cout << "Limiar invalido. Usando " << LIMIAR_PADRAO << ".\n";
+            limiar = LIMIAR_PADRAO;
+        }
+    }
+
+    // Medidas: usam arquivos próprios e não tocam em pagina.dat
+    if (medir) {
+        if (operacoes <= 0) operacoes = OPERACOES_MEDIDA;
+        configuracaoMedida cfg = {quadros, usarMmap, usarLog, tamPagina, preenchimento, limiar, alocacao, operacoes};
+        return executarMedidas(medir, cfg) ? 0 : 1;
+    }
+
+    // Carga em massa: constrói um novo pagina.dat antes de abri-lo
+    if (carga) {
+        if (!carregarOrdenado(carga, "pagina.dat", "pagina.wal", tamPagina, preenchimento, registros, limiar)) return 1;
+    }
+
+    if (threads < 1) threads = 1;
+
+    if (!abrir(arq, quadros, usarMmap, usarLog, limiar)) return 1;
+    arq.alocacao = alocacao;
+
+    // Roteiro: executa as operações sem o menu e imprime só o resumo
+    if (roteiro) {
+        bool ok = executarRoteiro(arq, roteiro);
+        fechar(arq);
+        if (formatoEstat && strcmp(formatoEstat, "prometheus") == 0) imprimirEstatisticasPrometheus(arq, cout);
+        else if (formatoEstat) imprimirEstatisticasJson(arq, cout);
+        return ok ? 0 : 1;
     }
 
     // Menu interativo
@@ -563,6 +7192,15 @@ int main() {
              << "\n5. Imprimir registros"
              << "\n6. Imprimir estrutura"
              << "\n7. Imprimir livres"
+             << "\n8. Imprimir indice"
+             << "\n9. Inserir lote"
+             << "\n10. Inserir ou substituir"
+             << "\n11. Pesquisar intervalo"
+             << "\n12. Remover intervalo"
+             << "\n13. Compactar"
+             << "\n14. Pesquisar lote"
+             << "\n15. Comprimir intervalo"
+             << "\n16. Agregar intervalo"
              << "\n0. Sair"
              << "\nOpcao: ";
         cin >> op;
@@ -573,13 +7211,13 @@ int main() {
                 cout << "Nome: "; cin >> d.nome;
                 inserir(arq, d);
                 break;
-                
+
             case 2:
                 cout << "Chave: "; cin >> d.chave;
                 cout << "Nome: "; cin >> d.nome;
                 inserirOrdenado(arq, d);
                 break;
-                
+
             case 3:
                 cout << "Chave a remover: "; cin >> chave;
                 if (remover(arq, chave)) {
@@ -588,39 +7226,152 @@ int main() {
                     cout << "Chave nao encontrada!\n";
                 }
                 break;
-                
+
             case 4:
                 cout << "Chave a pesquisar: "; cin >> chave;
                 if (pesquisa(arq, chave, resultado)) {
                     cout << "Registro encontrado:\n"
-                         << "Chave: " << resultado.lista.reg.chave
-                         << " | Nome: " << resultado.lista.reg.nome << "\n";
+                         << "Chave: " << resultado.chave
+                         << " | Nome: " << resultado.nome << "\n";
                 } else {
                     cout << "Registro nao encontrado!\n";
                 }
                 break;
-                
+
             case 5:
                 imprimirLista(arq);
                 break;
-                
+
             case 6:
                 imprimirEstrutura(arq);
                 break;
-                
+
             case 7:
                 imprimirFree(arq);
                 break;
-                
+
+            case 8:
+                imprimirIndice(arq);
+                break;
+
+            case 9: {
+                int quant;
+                cout << "Quantidade de registros: "; cin >> quant;
+                vector<dados> lote;
+                for (int k = 0; k < quant && cin; k++) {
+                    cout << "Chave e nome: "; cin >> d.chave >> d.nome;
+                    lote.push_back(d);
+                }
+                int inseridos = inserirLote(arq, lote);
+                cout << inseridos << " registro(s) inserido(s), "
+                     << (int)lote.size() - inseridos << " ignorado(s).\n";
+                break;
+            }
+
+            case 10:
+                cout << "Chave: "; cin >> d.chave;
+                cout << "Nome: "; cin >> d.nome;
+                if (inserirOuSubstituir(arq, d)) {
+                    cout << "Registro substituido!\n";
+                }
+                break;
+
+            case 11: {
+                tipoChave ini, fim;
+                int total = 0;
+                cout << "Chave inicial: "; cin >> ini;
+                cout << "Chave final: "; cin >> fim;
+                cursor cur;
+                posicionar(arq, cur, ini, fim);
+                while (proximo(arq, cur, resultado)) {
+                    cout << "Chave: " << resultado.chave
+                         << " | Nome: " << resultado.nome << "\n";
+                    total++;
+                }
+                cout << total << " registro(s) no intervalo.\n";
+                break;
+            }
+
+            case 12: {
+                tipoChave ini, fim;
+                cout << "Chave inicial: "; cin >> ini;
+                cout << "Chave final: "; cin >> fim;
+                cout << removerIntervalo(arq, ini, fim) << " registro(s) removido(s).\n";
+                break;
+            }
+
+            case 13: {
+                int passos, feitos, total = 0;
+                cout << "Passos (0 = ate o fim): "; cin >> passos;
+                do {
+                    feitos = compactar(arq, passos > 0 ? passos : 1000);
+                    total += feitos;
+                } while (passos <= 0 && feitos > 0);
+                cout << total << " pagina(s) movida(s).\n";
+                break;
+            }
+
+            case 14: {
+                int quant;
+                cout << "Quantidade de chaves: "; cin >> quant;
+                vector<tipoChave> chaves;
+                for (int k = 0; k < quant && cin; k++) {
+                    cout << "Chave: "; cin >> chave;
+                    chaves.push_back(chave);
+                }
+                vector<dados> resultados;
+                vector<bool> achados;
+                int encontrados = pesquisaLote(arq, chaves, resultados, achados);
+                for (size_t k = 0; k < chaves.size(); k++) {
+                    if (achados[k]) {
+                        cout << "Chave: " << resultados[k].chave
+                             << " | Nome: " << resultados[k].nome << "\n";
+                    } else {
+                        cout << "Chave " << chaves[k] << " nao encontrada!\n";
+                    }
+                }
+                cout << encontrados << " de " << chaves.size() << " chave(s) encontrada(s).\n";
+                break;
+            }
+
+            case 15: {
+                tipoChave ini, fim;
+                int comprimir;
+                cout << "Chave inicial: "; cin >> ini;
+                cout << "Chave final: "; cin >> fim;
+                cout << "Comprimir (1) ou descomprimir (0): "; cin >> comprimir;
+                cout << esfriar(arq, ini, fim, comprimir != 0) << " folha(s) alterada(s).\n";
+                break;
+            }
+
+            case 16: {
+                tipoChave ini, fim;
+                cout << "Chave inicial: "; cin >> ini;
+                cout << "Chave final: "; cin >> fim;
+                agregado a = agregarIntervalo(arq, ini, fim, threads);
+                cout << a.quant << " registro(s) no intervalo.\n";
+                if (a.quant > 0) {
+                    cout << "Menor chave: " << a.menor
+                         << "\nMaior chave: " << a.maior
+                         << "\nSoma das chaves: " << a.soma << "\n";
+                }
+                break;
+            }
+
             case 0:
                 cout << "Encerrando programa...\n";
                 break;
-                
+
             default:
                 cout << "Opcao invalida!\n";
         }
-    } while (op != 0);
 
-    arq.close();
+        // Cada operação que altera o arquivo é confirmada
+        if (op == 1 || op == 2 || op == 3 || op == 9 || op == 10 || op == 12 || op == 13 || op == 15) confirmar(arq);
+    } while (op != 0 && cin);
+
+    fechar(arq);
+    if (formatoEstat && strcmp(formatoEstat, "prometheus") == 0) imprimirEstatisticasPrometheus(arq, cout);
+    else if (formatoEstat) imprimirEstatisticasJson(arq, cout);
     return 0;
-}
\ No newline at end of file
+}